@@ -4,6 +4,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -15,8 +17,21 @@
 #define SYSTEM_SEPARATOR "/"
 
 
-#define pixel_at_m(r, x, y) (*(r.data + (y) * r.width + (x)))
-#define pixel_at_pm(r, x, y) (*(r->data + (y) * r->width + (x)))
+#define pixel_at_m(r, x, y) (*(r.data + (y) * r.stride + (x)))
+#define pixel_at_pm(r, x, y) (*(r->data + (y) * r->stride + (x)))
+
+/* RAFGL_LAYOUT_TILED rasters: rows of 8x8 tiles, the pixels of a tile in Z order so every 4x4 quarter is one cache line */
+#define __tile_spread_m(v) (((v) & 1) | (((v) & 2) << 1) | (((v) & 4) << 2))
+#define __tile_offset_m(stride, x, y) (((y) >> 3) * ((stride) << 3) + (((x) >> 3) << 6) + __tile_spread_m((x) & 7) + (__tile_spread_m((y) & 7) << 1))
+#define tiled_pixel_at_m(r, x, y) (*(r.data + __tile_offset_m(r.stride, x, y)))
+#define tiled_pixel_at_pm(r, x, y) (*(r->data + __tile_offset_m(r->stride, x, y)))
+/* either layout, for kernels taking both */
+#define layout_pixel_at_m(r, x, y) (*(r.data + (r.layout == RAFGL_LAYOUT_TILED ? __tile_offset_m(r.stride, x, y) : (y) * r.stride + (x))))
+#define layout_pixel_at_pm(r, x, y) (*(r->data + (r->layout == RAFGL_LAYOUT_TILED ? __tile_offset_m(r->stride, x, y) : (y) * r->stride + (x))))
+
+/* byte (x, y) of plane c (0 r, 1 g, 2 b, 3 a) of a planar raster */
+#define plane_at_m(p, c, x, y) (*(p.planes[c] + (y) * p.stride + (x)))
+#define plane_at_pm(p, c, x, y) (*(p->planes[c] + (y) * p->stride + (x)))
 
 
 #define rafgl_abs_m(x) ((x) >= 0 ? (x) : -(x))
@@ -28,6 +43,69 @@
 #define rafgl_RGBA(r, g, b, a) (((r) << 0) | ((g) << 8) | ((b) << 16) | ((a) << 24))
 #define rafgl_RGB(r, g, b) rafgl_RGBA(r, g, b, 0xff)
 
+/* flags for the *_flipped blitters */
+#define RAFGL_FLIP_HORIZONTAL 1
+#define RAFGL_FLIP_VERTICAL 2
+
+/* how rafgl_texture_load_from_raster moves pixels to the GPU */
+#define RAFGL_UPLOAD_DIRECT 0
+#define RAFGL_UPLOAD_PBO 1
+/* or-ed with one of the above, uploads only the dirty rectangles of rasters that track them */
+#define RAFGL_UPLOAD_DIRTY 2
+
+#define RAFGL_UPLOAD_RING_SIZE 3
+
+/* past this many rectangles new ones are folded into existing ones */
+#define RAFGL_DIRTY_MAX_RECTS 32
+/* pixels a merge may waste before two separate uploads are cheaper */
+#define RAFGL_DIRTY_MERGE_SLACK 4096
+
+/* layer flags */
+/* replaces what is below it instead of being colour keyed over it, the bottom layer has to be opaque */
+#define RAFGL_LAYER_OPAQUE 1
+/* drawn into by hand every frame, the compositor only wipes last frame's drawing in rafgl_compositor_begin_frame */
+#define RAFGL_LAYER_VOLATILE 2
+
+#define RAFGL_MAX_LAYERS 8
+
+/* tilemaps are rendered and cached in square chunks of this many tiles */
+#ifndef RAFGL_TILEMAP_CHUNK
+#define RAFGL_TILEMAP_CHUNK 32
+#endif
+
+/* raster rows start on this many bytes (a cache line, and a whole vector for any SIMD width in use) and are padded to it */
+#define RAFGL_ROW_ALIGN 64
+
+/* raster storage orders. everything takes linear rasters, only the functions that say so take tiled ones.
+   draws, blurs, resamples, spans and trims leave tiled rasters alone (-1 where they return a status) */
+#define RAFGL_LAYOUT_LINEAR 0
+#define RAFGL_LAYOUT_TILED 1
+/* edge of a RAFGL_LAYOUT_TILED tile */
+#define RAFGL_TILE_SIZE 8
+
+/* bytes the frame arena starts with, it grows to the high-water mark of any frame that overflows it */
+#ifndef RAFGL_FRAME_ARENA_SIZE
+#define RAFGL_FRAME_ARENA_SIZE (8 << 20)
+#endif
+
+/* filters for the scaled blitters */
+#define RAFGL_SAMPLE_NEAREST 0
+#define RAFGL_SAMPLE_BILINEAR 1
+
+/* asset pack entry types */
+#define RAFGL_PACK_RASTER 0
+#define RAFGL_PACK_SPRITESHEET 1
+#define RAFGL_PACK_ATLAS 2
+
+#define RAFGL_PACK_VERSION 2
+/* pixel blocks start on cache line boundaries */
+#define RAFGL_PACK_ALIGN 64
+
+/* states of an asynchronous load */
+#define RAFGL_LOAD_PENDING 0
+#define RAFGL_LOAD_DONE 1
+#define RAFGL_LOAD_FAILED 2
+
 
 typedef union _rafgl_pixel_rgb_t
 {
@@ -41,12 +119,217 @@ typedef union _rafgl_pixel_rgb_t
 
 } rafgl_pixel_rgb_t;
 
+/* run of opaque pixels in one raster row, tinted runs consist only of RAFGL_COLOUR_KEY_MOJ pixels */
+typedef struct _rafgl_span_t
+{
+    int x, length;
+    int tinted;
+} rafgl_span_t;
+
+/* per-row opaque runs of a raster. rows are split into cells of cell_width pixels (spritesheet frames) and runs never cross a cell */
+typedef struct _rafgl_span_cache_t
+{
+    int cell_width, cells_per_row;
+    int *first;
+    rafgl_span_t *spans;
+    int span_count;
+} rafgl_span_cache_t;
+
+typedef struct _rafgl_rect_t
+{
+    int x, y, width, height;
+} rafgl_rect_t;
+
+/* tight box around the opaque pixels of every cell_width x cell_height cell of a raster, relative to the cell.
+   fully keyed cells get an empty box */
+typedef struct _rafgl_trim_t
+{
+    int cell_width, cell_height;
+    int cells_x, cells_y;
+    rafgl_rect_t *boxes;
+} rafgl_trim_t;
+
+/* areas of a raster written since it was last uploaded */
+typedef struct _rafgl_dirty_list_t
+{
+    int count;
+    rafgl_rect_t rects[RAFGL_DIRTY_MAX_RECTS];
+} rafgl_dirty_list_t;
+
 typedef struct _rafgl_raster
 {
     int width, height;
+    /* pixels from the start of one row to the start of the next, at least width */
+    int stride;
     rafgl_pixel_rgb_t *data;
+    rafgl_span_cache_t *spans;
+    rafgl_dirty_list_t *dirty;
+    /* changes every time the dirty list is cleared, a texture whose last upload saw another value cannot trust the list */
+    uint64_t dirty_generation;
+    rafgl_trim_t *trim;
+    /* data belongs to someone else (an asset pack or a parent raster), cleanup leaves it alone */
+    int borrowed;
+    /* raster a view looks into and where the view starts in it, NULL for rasters owning their pixels */
+    struct _rafgl_raster *parent;
+    int parent_x, parent_y;
+    /* data lives in the frame arena and is gone once the frame ends */
+    int transient;
+    /* RAFGL_LAYOUT_LINEAR or RAFGL_LAYOUT_TILED, tiled rasters pad the height to whole tiles */
+    int layout;
+    /* blits only write inside this, the whole raster by default */
+    rafgl_rect_t clip;
 } rafgl_raster_t;
 
+/* the channels of a raster stored apart, every plane one byte per pixel. channel-wise maths then fills whole vectors with
+   one channel instead of shuffling interleaved pixels */
+typedef struct _rafgl_planar_t
+{
+    int width, height;
+    /* bytes from the start of one plane row to the next, a multiple of RAFGL_ROW_ALIGN */
+    int stride;
+    /* r, g, b and a, cut from one allocation */
+    uint8_t *planes[4];
+    /* the planes live in the frame arena and are gone once the frame ends */
+    int transient;
+} rafgl_planar_t;
+
+/* repaints area of a cached layer, blits into it are already clipped to area */
+typedef void (*rafgl_layer_render_fn)(rafgl_raster_t *layer, const rafgl_rect_t *area, void *ctx);
+
+typedef struct _rafgl_layer_t
+{
+    rafgl_raster_t raster;
+    int flags;
+    rafgl_layer_render_fn render;
+    void *ctx;
+    /* areas to re-render, for volatile layers the areas drawn last frame */
+    rafgl_dirty_list_t invalid;
+} rafgl_layer_t;
+
+/* stack of cached layers, composited into a target raster only where something changed */
+typedef struct _rafgl_compositor_t
+{
+    int width, height;
+    int layer_count;
+    rafgl_layer_t layers[RAFGL_MAX_LAYERS];
+    rafgl_dirty_list_t damage;
+} rafgl_compositor_t;
+
+/* handle to an image packed into an atlas, in pixels and in normalized texture coordinates.
+   only the trimmed box is packed, it sits at (offset_x, offset_y) inside the source_width x source_height original */
+typedef struct _rafgl_atlas_region_t
+{
+    int x, y, width, height;
+    int offset_x, offset_y;
+    int source_width, source_height;
+    float u0, v0, u1, v1;
+} rafgl_atlas_region_t;
+
+/* many images packed into one raster with a skyline packer */
+typedef struct _rafgl_atlas_t
+{
+    rafgl_raster_t raster;
+    int padding;
+
+    /* top edge of the packed area as segments from left to right, width is the segment length */
+    rafgl_rect_t *skyline;
+    int skyline_count, skyline_capacity;
+
+    rafgl_atlas_region_t *regions;
+    int region_count, region_capacity;
+} rafgl_atlas_t;
+
+typedef struct _rafgl_tilemap_chunk_t
+{
+    /* pre-rendered tiles, NULL data until the chunk is first seen or after it is evicted */
+    rafgl_raster_t raster;
+    int dirty;
+    int last_used;
+} rafgl_tilemap_chunk_t;
+
+/* grid of tile indices into a tileset, tiles are anchored at the bottom left of their cell and may be taller than it */
+typedef struct _rafgl_tilemap_t
+{
+    int width, height;
+    int tile_width, tile_height;
+    /* how far the tallest tile reaches above its cell */
+    int overhang;
+    int *tiles;
+
+    rafgl_raster_t *tileset;
+    /* when set, tile i is region atlas_first + i of the atlas instead of tileset[i] */
+    rafgl_atlas_t *atlas;
+    int atlas_first;
+    int tileset_count;
+    rafgl_pixel_rgb_t tint;
+
+    int chunks_x, chunks_y;
+    rafgl_tilemap_chunk_t *chunks;
+
+    /* indices of the chunks holding a raster, at most cache_limit of them survive a draw */
+    int *cached;
+    int cached_count, cache_limit;
+    int frame;
+} rafgl_tilemap_t;
+
+/* axis aligned box in a spatial hash, id is its index in the items array and stays valid until removed */
+typedef struct _rafgl_spatial_item_t
+{
+    int x, y, width, height;
+    int alive;
+    /* head of the item's node chain, or the next free item while unused */
+    int first_node;
+    int mark;
+} rafgl_spatial_item_t;
+
+/* one item in one grid cell, linked into the bucket of that cell and into the item's own chain */
+typedef struct _rafgl_spatial_node_t
+{
+    int item;
+    int cx, cy;
+    int prev, next;
+    int item_next;
+} rafgl_spatial_node_t;
+
+/* uniform grid hashed into a power of two bucket table. items and nodes live in flat arrays with free lists,
+   so inserts, moves and removals do not allocate once the arrays have grown to the working set */
+typedef struct _rafgl_spatial_hash_t
+{
+    int cell_size;
+
+    rafgl_spatial_item_t *items;
+    int item_count, item_capacity, free_item;
+
+    rafgl_spatial_node_t *nodes;
+    int node_capacity, free_node;
+
+    int *buckets;
+    int bucket_count;
+
+    int stamp;
+} rafgl_spatial_hash_t;
+
+/* entities kept as parallel arrays, slots [0, count) are all alive. despawning moves the last entity into the hole,
+   so slots change while ids stay put, slot[id] maps one to the other */
+typedef struct _rafgl_entities_t
+{
+    int count, capacity;
+
+    float *x, *y;
+    float *vx, *vy;
+
+    /* seconds left on the current frame, and how long every frame lasts */
+    float *frame_time, *frame_duration;
+    int *frame, *frame_count, *row;
+    /* index into the spritesheet array given to rafgl_entities_draw */
+    int *sprite;
+
+    int *id;
+    int *slot;
+    int id_count, id_capacity, free_id;
+} rafgl_entities_t;
+
+
 typedef struct _rafgl_spritesheet_t
 {
     rafgl_raster_t sheet;
@@ -55,10 +338,117 @@ typedef struct _rafgl_spritesheet_t
 
 } rafgl_spritesheet_t;
 
+/* one frame of a clip: which cell of the spritesheet and for how many seconds */
+typedef struct _rafgl_anim_frame_t
+{
+    int sheet_x, sheet_y;
+    float duration;
+} rafgl_anim_frame_t;
+
+/* frame sequence over a spritesheet, played in a loop or once */
+typedef struct _rafgl_anim_clip_t
+{
+    rafgl_spritesheet_t *sheet;
+    rafgl_anim_frame_t *frames;
+    int frame_count;
+    int loop;
+    /* sum of the frame durations */
+    float length;
+} rafgl_anim_clip_t;
+
+/* playback state of one clip, time is how far into the current frame it is */
+typedef struct _rafgl_animator_t
+{
+    const rafgl_anim_clip_t *clip;
+    int frame;
+    float time;
+    float speed;
+    int playing;
+} rafgl_animator_t;
+
+/* one named asset in a pack, offsets are from the start of the file. cell_width is 0 when no trim is stored */
+typedef struct _rafgl_pack_entry_t
+{
+    char name[64];
+    uint32_t type;
+    int32_t width, height;
+    int32_t cell_width, cell_height;
+    int32_t sheet_width, sheet_height;
+    int32_t region_count;
+    int32_t stride;
+    uint64_t pixels, trim, regions;
+} rafgl_pack_entry_t;
+
+typedef struct _rafgl_pack_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t count;
+    uint64_t index;
+} rafgl_pack_header_t;
+
+/* a pack mapped into memory, rasters handed out point straight into it and must not outlive it */
+typedef struct _rafgl_pack_t
+{
+    unsigned char *base;
+    size_t size;
+    int count;
+    const rafgl_pack_entry_t *entries;
+    void *mapping;
+} rafgl_pack_t;
+
+typedef struct _rafgl_pack_writer_t
+{
+    FILE *file;
+    rafgl_pack_entry_t *entries;
+    int count, capacity;
+} rafgl_pack_writer_t;
+
+/* one image decoding on the job pool into a raster or a spritesheet owned by the caller */
+typedef struct _rafgl_load_t
+{
+    char path[256];
+    rafgl_raster_t *raster;
+    rafgl_spritesheet_t *spritesheet;
+    int sheet_width, sheet_height;
+    int state;
+} rafgl_load_t;
+
+/* a group of loads that is started, polled and waited on together */
+typedef struct _rafgl_loader_t
+{
+    rafgl_load_t *loads;
+    int count, capacity;
+    void *batch;
+} rafgl_loader_t;
+
+typedef struct _rafgl_texture_upload_stats_t
+{
+    /* seconds spent in the last upload, and the part of it spent blocked on the GPU */
+    double upload_time;
+    double fence_wait_time;
+
+    double upload_time_total;
+    double fence_wait_time_total;
+    int uploads;
+} rafgl_texture_upload_stats_t;
+
 typedef struct _rafgl_texture_t
 {
     GLuint tex_id;
     int width, height, channels;
+
+    int upload_mode;
+    GLuint pbo[RAFGL_UPLOAD_RING_SIZE];
+    GLsync fences[RAFGL_UPLOAD_RING_SIZE];
+    int pbo_index, pbo_size;
+    rafgl_texture_upload_stats_t stats;
+    /* raster last uploaded and its dirty_generation right after, dirty uploads fall back to full ones when either changed */
+    const rafgl_raster_t *source;
+    uint64_t source_generation;
+
+    /* headless mode keeps the uploaded pixels here instead of on the GPU */
+    rafgl_raster_t capture;
 } rafgl_texture_t;
 
 typedef struct _rafgl_list_t
@@ -77,6 +467,8 @@ typedef struct _rafgl_game_t
     int next_game_state;
 
     GLFWwindow *window;
+    int headless;
+    int frame_limit;
 } rafgl_game_t;
 
 typedef struct _rafgl_game_data_t
@@ -107,22 +499,218 @@ typedef struct _rafgl_button_t
 
 /* initializes the GLFW library, GLEW and the window. If full-screen mode is selected, width and hight are unused and the monitor resolution is used instead */
 int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int window_height, int fullscreen);
+/* initializes rafgl without a window or GL context. game states run against a width x height software framebuffer,
+   textures are captured in memory and time comes from a clock that moves one step per frame */
+int rafgl_game_init_headless(rafgl_game_t *game, int width, int height);
+/* stops rafgl_game_start after the given number of frames, 0 runs until the window closes or a quit is requested */
+void rafgl_game_set_frame_limit(rafgl_game_t *game, int frames);
+
+/* scratch memory for the current frame, 64 byte aligned and not cleared. main thread only, nothing is freed on its own:
+   all of it goes at once in rafgl_frame_arena_reset. past the arena's size it falls back to the heap until the next reset */
+void *rafgl_frame_alloc(size_t size);
+/* releases everything rafgl_frame_alloc handed out, rafgl_game_start does this after every frame */
+void rafgl_frame_arena_reset(void);
+/* resizes the arena ahead of time, -1 while the current frame is using it */
+int rafgl_frame_arena_reserve(size_t size);
+/* most bytes any frame has asked for so far, including what spilled to the heap */
+size_t rafgl_frame_arena_high_water(void);
+/* stops rafgl_game_start after the current frame */
+void rafgl_game_request_quit(void);
+/* in headless mode, what the last rafgl_texture_show call put on the screen. NULL when a window is used */
+rafgl_raster_t* rafgl_game_get_framebuffer(void);
+/* seconds since init, from GLFW or from the headless clock */
+double rafgl_clock_get(void);
+/* moves the clock to the given time */
+void rafgl_clock_set(double seconds);
+/* how far the headless clock advances every frame, 1/60 s by default */
+void rafgl_clock_set_step(double seconds);
 /* creates a new game state based on the appropriate function pointers */
 void rafgl_game_add_game_state(rafgl_game_t *game, void (*init)(GLFWwindow *window, void *args), void (*update)(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args), void (*render)(GLFWwindow *window, void *args), void (*cleanup)(GLFWwindow *window, void *args));
 
 /* allocates and NULLs the needed memory for the raster */
 int rafgl_raster_init(rafgl_raster_t *raster, int width, int height);
-/* copies the raster (resizes destination raster to fit the source raster) */
+/* copies the raster (resizes destination raster to fit the source raster, -1 for a view of another size).
+   tiled rasters go through rafgl_raster_copy_layout and are not resized */
 int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from);
-/* reads an image from the disk and loads it into the raster (raster should NOT BE "inited" beforehand */
+/* reads an image from the disk and loads it into the raster (raster should NOT BE "inited" beforehand), -1 if it cannot be read */
 int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path);
-/* */
+/* tiled rasters are written out in linear order */
 int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path);
 /* free */
 int rafgl_raster_cleanup(rafgl_raster_t *raster);
+/* same as rafgl_raster_init, but the pixels come from the frame arena and are not cleared. the raster is only valid until the
+   end of the frame, cleanup is only needed for spans, trims and dirty tracking built on it */
+int rafgl_raster_init_transient(rafgl_raster_t *raster, int width, int height);
+/* same as rafgl_raster_init, with the pixels stored in RAFGL_LAYOUT_TILED order for kernels walking 2D neighbourhoods */
+int rafgl_raster_init_tiled(rafgl_raster_t *raster, int width, int height);
+/* copies from into to (either layout each), to is inited in the given layout if its data is NULL. -1 if the sizes differ */
+int rafgl_raster_copy_layout(rafgl_raster_t *to, rafgl_raster_t *from, int layout);
+/* rotates from by 90 degrees into to, which is from->height x from->width (inited in from's layout if its data is NULL).
+   either layout, walked a tile at a time so columns do not thrash the cache. -1 if to has the wrong size */
+int rafgl_raster_rotate_90(rafgl_raster_t *to, rafgl_raster_t *from, int clockwise);
+/* makes view a width x height window at (x, y) of parent (clipped to it) without copying anything. every raster function takes
+   a view, writes land in the parent and are marked dirty there. views of views work, clean the views up before the parent.
+   tiled rasters have no views, -1 */
+int rafgl_raster_view(rafgl_raster_t *view, rafgl_raster_t *parent, int x, int y, int width, int height);
 
 void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height);
 void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y);
+/* view of a single frame of the sheet */
+int rafgl_spritesheet_frame_view(rafgl_raster_t *view, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y);
+/* draws a frame mirrored by RAFGL_FLIP_HORIZONTAL and/or RAFGL_FLIP_VERTICAL, at no extra cost. a tiled raster or sheet
+   works, but costs a copy of the whole raster there and back on every call */
+void rafgl_raster_draw_spritesheet_flipped(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, int flags);
+/* draws a frame stretched to width x height, sampled with RAFGL_SAMPLE_NEAREST or RAFGL_SAMPLE_BILINEAR, colour key still applies.
+   tiled rasters cost a whole copy each way per call, as for rafgl_raster_draw_spritesheet_flipped */
+void rafgl_raster_draw_spritesheet_scaled(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, int width, int height, int filter, int flags);
+
+/* caches the opaque runs of every row so blits copy whole runs instead of testing each pixel against the colour key.
+   call after the contents are final (and after rafgl_game_init, which sets the colour keys), rebuild if they change.
+   -1 with no cache for an empty (not loaded) or tiled raster, or when memory runs out */
+int rafgl_raster_build_spans(rafgl_raster_t *raster);
+/* same as above, but runs are split on frame boundaries so every frame can be blitted from the cache */
+int rafgl_spritesheet_build_spans(rafgl_spritesheet_t *spritesheet);
+/* drops the span cache, blits go back to testing every pixel */
+void rafgl_raster_spans_cleanup(rafgl_raster_t *raster);
+
+/* finds the opaque box of every cell_width x cell_height cell, blits of a whole cell then skip its keyed margins.
+   rafgl_raster_load_from_image and rafgl_spritesheet_init do this (after rafgl_game_init), rafgl writes to the raster drop it */
+int rafgl_raster_trim(rafgl_raster_t *raster, int cell_width, int cell_height);
+/* share of the cell's pixels the blits skip, pass -1 for the whole raster. 0 without a trim */
+float rafgl_raster_trimmed_fraction(rafgl_raster_t *raster, int cell);
+/* drops the trim, blits go back to walking every cell whole */
+void rafgl_raster_trim_cleanup(rafgl_raster_t *raster);
+
+/* starts recording the areas the rafgl draw functions write to, the whole raster starts out dirty */
+int rafgl_raster_track_dirty(rafgl_raster_t *raster);
+/* records a write the draw functions do not know about (direct pixel_at_m access), clipped to the raster.
+   drops the span cache and trim of the raster and of every parent it is a view of */
+void rafgl_raster_mark_dirty(rafgl_raster_t *raster, int x, int y, int width, int height);
+/* folds overlapping and nearby dirty rectangles together, returns how many are left */
+int rafgl_raster_merge_dirty(rafgl_raster_t *raster);
+/* forgets the recorded areas, done by rafgl_texture_load_from_raster after every upload. a texture that uploaded the raster
+   before the clear goes back to a full upload the next time */
+void rafgl_raster_clear_dirty(rafgl_raster_t *raster);
+/* limits the blitters to the given area of the raster (clipped to it), pass the full size to lift the limit */
+void rafgl_raster_set_clip(rafgl_raster_t *raster, int x, int y, int width, int height);
+
+/* creates a compositor producing width x height frames, layers are added bottom to top */
+int rafgl_compositor_init(rafgl_compositor_t *compositor, int width, int height);
+/* adds a layer on top and returns its index. cached layers start invalid and are painted by render, volatile ones start empty */
+int rafgl_compositor_add_layer(rafgl_compositor_t *compositor, int flags, rafgl_layer_render_fn render, void *ctx);
+/* the raster a layer keeps, volatile layers are drawn into directly */
+rafgl_raster_t* rafgl_compositor_layer(rafgl_compositor_t *compositor, int index);
+/* marks an area of a cached layer for re-rendering on the next compose */
+void rafgl_compositor_invalidate(rafgl_compositor_t *compositor, int index, int x, int y, int width, int height);
+/* wipes what volatile layers drew last frame, call before drawing into them */
+void rafgl_compositor_begin_frame(rafgl_compositor_t *compositor);
+/* re-renders invalid areas and rebuilds only the changed parts of target from the layers, returns how many areas changed */
+int rafgl_compositor_compose(rafgl_compositor_t *compositor, rafgl_raster_t *target);
+/* free */
+void rafgl_compositor_cleanup(rafgl_compositor_t *compositor);
+
+/* creates a width x height atlas, empty space holds RAFGL_COLOUR_KEY. padding pixels are left between packed images */
+int rafgl_atlas_init(rafgl_atlas_t *atlas, int width, int height, int padding);
+/* copies the image into the atlas and returns its region index, -1 when it does not fit. larger images first pack tighter */
+int rafgl_atlas_add(rafgl_atlas_t *atlas, rafgl_raster_t *image);
+/* same as above for the width x height block at (src_x, src_y) of the image */
+int rafgl_atlas_add_region(rafgl_atlas_t *atlas, rafgl_raster_t *image, int src_x, int src_y, int width, int height);
+/* packs every frame as its own region, frame (x, y) is region first + y * sheet_width + x. returns first, or -1 with the atlas left as it was */
+int rafgl_atlas_add_spritesheet(rafgl_atlas_t *atlas, rafgl_spritesheet_t *spritesheet);
+/* call once everything is added, caches the opaque runs for the region blits */
+void rafgl_atlas_finish(rafgl_atlas_t *atlas);
+/* colour keyed blit of a region, RAFGL_COLOUR_KEY_MOJ pixels are replaced by boja. flags as for the *_flipped blitters */
+void rafgl_raster_draw_region(rafgl_raster_t *raster, rafgl_atlas_t *atlas, int region, int x, int y, rafgl_pixel_rgb_t boja, int flags);
+/* free */
+void rafgl_atlas_cleanup(rafgl_atlas_t *atlas);
+
+/* maps a pack written by rafgl_pack_writer_*, returns -1 if it is missing or was built by another version */
+int rafgl_pack_open(rafgl_pack_t *pack, const char *path);
+/* index of the named entry, -1 if there is none */
+int rafgl_pack_find(rafgl_pack_t *pack, const char *name);
+/* the raster views the pixels in the pack, nothing is decoded or copied. writes only change this process' copy */
+int rafgl_pack_raster(rafgl_pack_t *pack, const char *name, rafgl_raster_t *raster);
+int rafgl_pack_spritesheet(rafgl_pack_t *pack, const char *name, rafgl_spritesheet_t *spritesheet);
+/* a packed atlas is full, nothing more can be added. rafgl_atlas_finish it as usual */
+int rafgl_pack_atlas(rafgl_pack_t *pack, const char *name, rafgl_atlas_t *atlas);
+/* unmaps the pack, clean the views up first */
+void rafgl_pack_close(rafgl_pack_t *pack);
+
+/* starts writing a pack, the assets are stored with their trims, pixels in the byte order of this machine */
+int rafgl_pack_writer_open(rafgl_pack_writer_t *writer, const char *path);
+int rafgl_pack_writer_add_raster(rafgl_pack_writer_t *writer, const char *name, rafgl_raster_t *raster);
+int rafgl_pack_writer_add_spritesheet(rafgl_pack_writer_t *writer, const char *name, rafgl_spritesheet_t *spritesheet);
+int rafgl_pack_writer_add_atlas(rafgl_pack_writer_t *writer, const char *name, rafgl_atlas_t *atlas);
+/* writes the index, the pack is unusable until this is called */
+int rafgl_pack_writer_close(rafgl_pack_writer_t *writer);
+
+/* creates a width x height map of tile 0, tileset entries are the tile rasters (not copied, must outlive the map) */
+int rafgl_tilemap_init(rafgl_tilemap_t *tilemap, int width, int height, int tile_width, int tile_height, rafgl_raster_t *tileset, int tileset_count);
+/* same as above, with tiles taken from tile_count consecutive atlas regions starting at first_region */
+int rafgl_tilemap_init_from_atlas(rafgl_tilemap_t *tilemap, int width, int height, int tile_width, int tile_height, rafgl_atlas_t *atlas, int first_region, int tile_count);
+/* tile index at (x, y), -1 outside the map */
+int rafgl_tilemap_get_tile(rafgl_tilemap_t *tilemap, int x, int y);
+/* changes a tile, negative indices leave the cell empty. only the chunk holding it is rendered again */
+void rafgl_tilemap_set_tile(rafgl_tilemap_t *tilemap, int x, int y, int tile);
+/* colour that replaces RAFGL_COLOUR_KEY_MOJ pixels of the tiles. applied when chunks are drawn, so changing it renders nothing again */
+void rafgl_tilemap_set_tint(rafgl_tilemap_t *tilemap, rafgl_pixel_rgb_t tint);
+/* how many chunk rasters are kept around, least recently drawn ones are freed first. 4 by default, a chunk holds
+   RAFGL_TILEMAP_CHUNK^2 tiles at 4 bytes per pixel (about 17 MB with 64 px tiles), and the limit grows to what is on screen at once */
+void rafgl_tilemap_set_cache_limit(rafgl_tilemap_t *tilemap, int chunks);
+/* draws the part of the map seen from (camera_x, camera_y) into the clip area of raster, touching only visible chunks */
+void rafgl_tilemap_draw(rafgl_tilemap_t *tilemap, rafgl_raster_t *raster, int camera_x, int camera_y);
+/* free */
+void rafgl_tilemap_cleanup(rafgl_tilemap_t *tilemap);
+
+/* creates an empty hash with square cells of cell_size pixels, sized for capacity items (it grows past that) */
+int rafgl_spatial_init(rafgl_spatial_hash_t *hash, int cell_size, int capacity);
+/* adds a box and returns its id */
+int rafgl_spatial_insert(rafgl_spatial_hash_t *hash, int x, int y, int width, int height);
+/* updates a box, only relinks it when it crosses into other cells */
+void rafgl_spatial_move(rafgl_spatial_hash_t *hash, int id, int x, int y, int width, int height);
+/* removes a box, its id may be handed out again */
+void rafgl_spatial_remove(rafgl_spatial_hash_t *hash, int id);
+/* writes the ids of up to max_results boxes overlapping the rectangle to result, returns how many overlap in total */
+int rafgl_spatial_query(rafgl_spatial_hash_t *hash, int x, int y, int width, int height, int *result, int max_results);
+/* calls fn once for every overlapping pair (a < b) and returns the number of pairs, fn may be NULL */
+int rafgl_spatial_pairs(rafgl_spatial_hash_t *hash, void (*fn)(int a, int b, void *ctx), void *ctx);
+/* free */
+void rafgl_spatial_cleanup(rafgl_spatial_hash_t *hash);
+
+/* creates an empty entity store with room for capacity entities (it grows past that) */
+int rafgl_entities_init(rafgl_entities_t *store, int capacity);
+/* adds an entity standing still at (x, y), looping frame_count frames of a spritesheet row. returns its id */
+int rafgl_entities_spawn(rafgl_entities_t *store, float x, float y, int sprite, int row, int frame_count, float frame_duration);
+/* removes an entity, its id may be handed out again */
+void rafgl_entities_despawn(rafgl_entities_t *store, int id);
+/* current slot of an entity in the arrays, -1 if the id is not alive */
+int rafgl_entities_slot(rafgl_entities_t *store, int id);
+/* pixels per second */
+void rafgl_entities_set_velocity(rafgl_entities_t *store, int id, float vx, float vy);
+/* moves every entity by its velocity and steps its animation, several entities per instruction where the CPU allows.
+   a dt longer than a frame advances every frame it covers, wrapping around the row */
+void rafgl_entities_update(rafgl_entities_t *store, float dt);
+/* blits every entity that overlaps the clip area of raster, seen from (camera_x, camera_y) */
+void rafgl_entities_draw(rafgl_entities_t *store, rafgl_raster_t *raster, rafgl_spritesheet_t *sheets, int camera_x, int camera_y);
+/* free */
+void rafgl_entities_cleanup(rafgl_entities_t *store);
+
+/* allocates a clip of frame_count frames, fill them in with rafgl_anim_clip_set_frame */
+int rafgl_anim_clip_init(rafgl_anim_clip_t *clip, rafgl_spritesheet_t *sheet, int frame_count, int loop);
+/* clip of frame_count consecutive cells of row sheet_y starting at column first, every one lasting frame_duration seconds */
+int rafgl_anim_clip_init_row(rafgl_anim_clip_t *clip, rafgl_spritesheet_t *sheet, int sheet_y, int first, int frame_count, float frame_duration, int loop);
+void rafgl_anim_clip_set_frame(rafgl_anim_clip_t *clip, int index, int sheet_x, int sheet_y, float duration);
+/* free */
+void rafgl_anim_clip_cleanup(rafgl_anim_clip_t *clip);
+/* starts the clip from its first frame at normal speed */
+void rafgl_animator_play(rafgl_animator_t *animator, const rafgl_anim_clip_t *clip);
+/* advances count animators by dt seconds. any dt works: frames are skipped exactly, one-shot clips stop on their last frame */
+void rafgl_animator_update(rafgl_animator_t *animators, int count, float dt);
+/* spritesheet cell of the current frame */
+int rafgl_animator_sheet_x(const rafgl_animator_t *animator);
+int rafgl_animator_sheet_y(const rafgl_animator_t *animator);
+/* draws the current frame, flags as for rafgl_raster_draw_spritesheet_flipped */
+void rafgl_animator_draw(const rafgl_animator_t *animator, rafgl_raster_t *raster, int x, int y, int flags);
 
 
 /* helpers function declarations start */
@@ -131,8 +719,11 @@ void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *
 void rafgl_texture_init(rafgl_texture_t *tex);
 /* loads a texture from the disk with basic settings */
 int rafgl_texture_load_basic(const char *texture_path, rafgl_texture_t *res);
-/* loads a texture from a raster in memory */
+/* loads a texture from a raster in memory. storage is allocated on the first upload and again only when the size changes */
 void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *raster);
+/* RAFGL_UPLOAD_DIRECT copies synchronously, RAFGL_UPLOAD_PBO streams through a ring of pixel unpack buffers so the
+   transfer of one frame overlaps the rasterisation of the next */
+void rafgl_texture_set_upload_mode(rafgl_texture_t *texture, int mode);
 /* shows the texture applied to a (-1, -1) (1, 1) NDC space quad */
 void rafgl_texture_show(const rafgl_texture_t *texture);
 /* free */
@@ -198,16 +789,81 @@ void rafgl_button_show(rafgl_raster_t *target, rafgl_button_t *btn);
 /* checks if the button is pressed (does not account for occlusion) */
 int rafgl_button_check(rafgl_button_t *btn, rafgl_game_data_t *game_data);
 
+/* box blurs all four channels of from into result, tmp holds the horizontal pass. all three rasters must be the same size,
+   a NULL tmp is scratch memory that only lives for the call. cost per pixel does not depend on the radius and both passes are split across the cores.
+   tiled rasters are blurred through linear copies */
 void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius);
 
+/* colour keyed blit of the whole of from, tiled rasters go through linear copies like rafgl_raster_draw_spritesheet_flipped */
 int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y, rafgl_pixel_rgb_t boja);
+int rafgl_raster_draw_raster_flipped(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y, rafgl_pixel_rgb_t boja, int flags);
 
+/* line and circle plot single pixels, so they write tiled rasters in place */
 void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour);
 void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour);
 void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour);
 
+/* bilinear resize of from into to, same result as rafgl_bilinear_sample per pixel (within 1 LSB). the per pixel blend is
+   0.16 fixed point. tiled rasters go through linear copies */
 void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from);
 
+/* planar rasters. effect chains convert in once, stay planar and convert back once before the upload. results may be the
+   source of the same call, every raster passed to one call must be the same size */
+
+/* allocates the four planes, cleared */
+int rafgl_planar_init(rafgl_planar_t *planar, int width, int height);
+/* same, but the planes come from the frame arena and are not cleared, valid until the end of the frame */
+int rafgl_planar_init_transient(rafgl_planar_t *planar, int width, int height);
+int rafgl_planar_cleanup(rafgl_planar_t *planar);
+/* splits a linear raster into planes, planar is inited if planes[0] is NULL. -1 if the sizes differ */
+int rafgl_planar_from_raster(rafgl_planar_t *planar, rafgl_raster_t *raster);
+/* interleaves the planes back, raster is inited if its data is NULL. -1 if the sizes differ or raster is tiled */
+int rafgl_planar_to_raster(rafgl_raster_t *raster, rafgl_planar_t *planar);
+/* rafgl_raster_box_blur on every plane, a NULL tmp is scratch memory that only lives for the call */
+void rafgl_planar_box_blur(rafgl_planar_t *result, rafgl_planar_t *tmp, rafgl_planar_t *from, int radius);
+/* rafgl_calculate_pixel_brightness into r, g and b (8 bit fixed point weights, within 1 of it), alpha is kept */
+void rafgl_planar_brightness(rafgl_planar_t *result, rafgl_planar_t *from);
+/* rafgl_lerppix per pixel, scale in 8 bit fixed point */
+void rafgl_planar_lerp(rafgl_planar_t *result, rafgl_planar_t *from, rafgl_planar_t *to, float scale);
+/* maps every channel through its own curve: result plane c = curves[c][from plane c] */
+void rafgl_planar_grade(rafgl_planar_t *result, rafgl_planar_t *from, const uint8_t curves[4][256]);
+
+/* job system. the raster functions above split large work across it on their own */
+
+/* starts the work-stealing pool with thread_count threads including the caller (0 means one per core). called on first use */
+int rafgl_jobs_init(int thread_count);
+/* stops and joins the worker threads */
+void rafgl_jobs_cleanup(void);
+/* number of threads work is split across, the calling thread included */
+int rafgl_jobs_thread_count(void);
+/* runs fn on chunks of at most grain indices covering [0, count) in parallel and returns once all are done. calls made from inside a job run inline */
+void rafgl_parallel_for(int count, int grain, void (*fn)(int begin, int end, void *ctx), void *ctx);
+/* runs fn on bands of rows covering the raster in parallel */
+void rafgl_parallel_for_rows(rafgl_raster_t *raster, void (*fn)(rafgl_raster_t *raster, int y_begin, int y_end, void *ctx), void *ctx);
+/* runs fn on tile_width x tile_height tiles covering the raster in parallel, the last row and column of tiles are clipped to the raster */
+void rafgl_parallel_for_tiles(rafgl_raster_t *raster, int tile_width, int tile_height, void (*fn)(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, void *ctx), void *ctx);
+
+/* asynchronous image loading, one image per job */
+
+/* a group of at most capacity loads */
+int rafgl_loader_init(rafgl_loader_t *loader, int capacity);
+/* queues a load and returns its handle, -1 when the group is full or already started. the raster must stay put until it is done */
+int rafgl_loader_add_image(rafgl_loader_t *loader, const char *path, rafgl_raster_t *raster);
+int rafgl_loader_add_spritesheet(rafgl_loader_t *loader, const char *path, rafgl_spritesheet_t *spritesheet, int sheet_width, int sheet_height);
+/* hands the group to the job pool's threads and returns at once, without a pool the loads run here.
+   parallel loops waiting on the pool never pick up a load, so a frame is not held up by a decode */
+void rafgl_loader_start(rafgl_loader_t *loader);
+/* RAFGL_LOAD_PENDING until the handle's raster may be used, then RAFGL_LOAD_DONE or RAFGL_LOAD_FAILED */
+int rafgl_loader_state(rafgl_loader_t *loader, int handle);
+/* 1 once every load in the group is finished */
+int rafgl_loader_done(rafgl_loader_t *loader);
+/* finished share of the group, for loading screens */
+float rafgl_loader_progress(rafgl_loader_t *loader);
+/* starts the group if needed and helps decode its loads until all of it is finished, -1 if any load failed */
+int rafgl_loader_wait(rafgl_loader_t *loader);
+/* waits for loads still running and frees the group, the loaded rasters stay with the caller */
+void rafgl_loader_cleanup(rafgl_loader_t *loader);
+
 
 
 extern rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
@@ -224,6 +880,25 @@ extern rafgl_pixel_rgb_t RAFGL_COLOUR_KEY_MOJ;// DODATO
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+/* SIMD kernels are only built for x86 with GCC/Clang, selected at runtime. Define RAFGL_NO_SIMD to force the scalar paths */
+#if !defined(RAFGL_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RAFGL_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#undef APIENTRY
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 /* rafgl core implementation */
 
 rafgl_pixel_rgb_t RAFGL_COLOUR_KEY;
@@ -231,6 +906,35 @@ rafgl_pixel_rgb_t RAFGL_COLOUR_KEY_MOJ;// DODATO
 
 static GLFWwindow *__window;
 static int __done = 0;
+static int __headless = 0;
+static int __quit_requested = 0;
+static double __clock_time = 0.0;
+static double __clock_step = 1.0 / 60.0;
+static rafgl_raster_t __headless_framebuffer;
+
+/* 0 until the SIMD kernels are picked, 1 while one thread picks them, 2 once every *_impl pointer is set */
+static int __cpu_dispatch_state = 0;
+static void __cpu_dispatch_init(void);
+
+/* the *_impl pointers may only be read after this, row jobs rely on the job pool having called it first */
+static inline void __cpu_dispatch(void)
+{
+    if(__atomic_load_n(&__cpu_dispatch_state, __ATOMIC_ACQUIRE) != 2)
+        __cpu_dispatch_init();
+}
+
+static struct
+{
+    unsigned char *base;
+    size_t size, used, high_water;
+    /* heap blocks of the current frame that did not fit, chained through their first bytes */
+    void *spill;
+    /* set while rafgl_game_start runs a frame */
+    int in_frame;
+} __frame_arena;
+
+/* set on the thread running rafgl_game_start, the only one that may touch the arena */
+static __thread int __frame_thread = 0;
 static int __window_width = 0, __window_height = 0;
 
 static uint8_t __keys_down[400];
@@ -293,6 +997,7 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
 {
     if(__done) return -1;
     __done = 1;
+    __cpu_dispatch();
 
 
 
@@ -340,6 +1045,8 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
     }
 
     game -> window = __window;
+    game -> headless = 0;
+    game -> frame_limit = 0;
     game -> current_game_state = -1;
     game -> next_game_state = -1;
     rafgl_list_init(&(game -> game_states), sizeof(rafgl_game_state_t));
@@ -377,359 +1084,4661 @@ int rafgl_game_init(rafgl_game_t *game, const char *title, int window_width, int
 }
 
 
-int rafgl_raster_init(rafgl_raster_t *raster, int width, int height)
+int rafgl_game_init_headless(rafgl_game_t *game, int width, int height)
 {
-    raster->data = calloc(width * height, sizeof(rafgl_pixel_rgb_t));
-    raster->width = width;
-    raster->height = height;
+    if(__done) return -1;
+    __done = 1;
+    __cpu_dispatch();
+
+    __window_width = width;
+    __window_height = height;
+    __headless = 1;
+    __clock_time = 0.0;
+
+    rafgl_raster_init(&__headless_framebuffer, width, height);
+
+    game -> window = NULL;
+    game -> headless = 1;
+    game -> frame_limit = 0;
+    game -> current_game_state = -1;
+    game -> next_game_state = -1;
+    rafgl_list_init(&(game -> game_states), sizeof(rafgl_game_state_t));
+
+    RAFGL_COLOUR_KEY.rgba = rafgl_RGB(255, 0, 254);
+    RAFGL_COLOUR_KEY_MOJ.rgba = rafgl_RGB(0, 128, 0);// DODATO
+
     return 0;
 }
 
-int rafgl_raster_cleanup(rafgl_raster_t *raster)
+void rafgl_game_set_frame_limit(rafgl_game_t *game, int frames)
 {
-    free(raster->data);
-    raster->height = 0;
-    raster->width = 0;
-    return 0;
+    game->frame_limit = frames;
 }
 
+void rafgl_game_request_quit(void)
+{
+    __quit_requested = 1;
+}
 
-void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height)
+rafgl_raster_t* rafgl_game_get_framebuffer(void)
 {
-    rafgl_raster_load_from_image(&(spritesheet->sheet), sheet_path);
-    spritesheet->sheet_width = sheet_width;
-    spritesheet->sheet_height = sheet_height;
-    spritesheet->frame_width = spritesheet->sheet.width / sheet_width;
-    spritesheet->frame_height = spritesheet->sheet.height / sheet_height;
+    return __headless ? &__headless_framebuffer : NULL;
 }
 
-void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y)
+double rafgl_clock_get(void)
 {
-    int fl, fr, fu, fd;
-    int flc, frc, fuc, fdc;
-    int xi, yi;
+    return __headless ? __clock_time : glfwGetTime();
+}
 
-    rafgl_pixel_rgb_t sampled;
+void rafgl_clock_set(double seconds)
+{
+    if(__headless)
+        __clock_time = seconds;
+    else
+        glfwSetTime(seconds);
+}
 
-    fl = x;
-    fr = x + spritesheet->frame_width;
-    fu = y;
-    fd = y + spritesheet->frame_height;
+void rafgl_clock_set_step(double seconds)
+{
+    __clock_step = seconds;
+}
 
-    flc = rafgl_max_m(fl, 0);
-    frc = rafgl_min_m(fr, raster->width);
-    fuc = rafgl_max_m(fu, 0);
-    fdc = rafgl_min_m(fd, raster->height);
 
-    for(yi = fuc; yi < fdc; yi++)
-    {
-        for(xi = flc; xi < frc; xi++)
-        {
-            sampled = pixel_at_m(spritesheet->sheet, sheet_x * spritesheet->frame_width + xi - fl, sheet_y * spritesheet->frame_height + yi - fu);
-            if(sampled.rgba != RAFGL_COLOUR_KEY.rgba)
-            {
-                pixel_at_pm(raster, xi, yi) = sampled;
-            }
-        }
-    }
+/* minimal portable threads, the job system below is built on them */
+#ifdef _WIN32
+typedef HANDLE __thread_t;
+typedef DWORD __thread_ret_t;
+#define __THREAD_CALL WINAPI
+#else
+typedef pthread_t __thread_t;
+typedef void *__thread_ret_t;
+#define __THREAD_CALL
+#endif
 
+typedef __thread_ret_t (__THREAD_CALL *__thread_fn)(void *arg);
+
+static int __thread_create(__thread_t *thread, __thread_fn fn, void *arg)
+{
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *thread == NULL ? -1 : 0;
+#else
+    return pthread_create(thread, NULL, fn, arg) == 0 ? 0 : -1;
+#endif
 }
 
+static void __thread_join(__thread_t thread)
+{
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
 
-int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
+static int __cpu_count(void)
 {
+    static int count = 0;
 
-    if(raster_to->data == NULL)
-    {
-        /* new raster */
-        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
-    }
-    else if(raster_to -> width != raster_from -> width || raster_to -> height != raster_from -> height)
+    if(count == 0)
     {
-        /* resize */
-        rafgl_raster_cleanup(raster_to);
-        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        count = info.dwNumberOfProcessors;
+#else
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        count = rafgl_clampi(count, 1, 64);
     }
+    return count;
+}
 
-    /* just copy */
-    memcpy(raster_to->data, raster_from->data, raster_from->width * raster_from->height * sizeof(rafgl_pixel_rgb_t));
-    return 0;
+static void __thread_yield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
 }
 
-int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path)
+#ifdef _WIN32
+typedef CRITICAL_SECTION __mutex_t;
+typedef CONDITION_VARIABLE __cond_t;
+#else
+typedef pthread_mutex_t __mutex_t;
+typedef pthread_cond_t __cond_t;
+#endif
+
+static void __mutex_init(__mutex_t *m)
 {
-    int width, height, channels;
-    raster->data = (rafgl_pixel_rgb_t *) stbi_load(image_path, &width, &height, &channels, 4);
-    raster->width = width;
-    raster->height = height;
-    return 0;
+#ifdef _WIN32
+    InitializeCriticalSection(m);
+#else
+    pthread_mutex_init(m, NULL);
+#endif
 }
 
-int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path)
+static void __mutex_destroy(__mutex_t *m)
 {
-    return stbi_write_png(image_path, raster->width, raster->height, 4, raster->data, 0);
+#ifdef _WIN32
+    DeleteCriticalSection(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
 }
 
-void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius)
+static void __mutex_lock(__mutex_t *m)
 {
-    int x, y;
-    float xn, yn, offset;
-    int sample_count = 2 * radius + 1;
+#ifdef _WIN32
+    EnterCriticalSection(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+static void __mutex_unlock(__mutex_t *m)
+{
+#ifdef _WIN32
+    LeaveCriticalSection(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+static void __cond_init(__cond_t *c)
+{
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c, NULL);
+#endif
+}
 
-    rafgl_pixel_rgb_t sampled, resulting;
+static void __cond_destroy(__cond_t *c)
+{
+#ifndef _WIN32
+    pthread_cond_destroy(c);
+#endif
+}
 
-    int r, g, b;
+static void __cond_wait(__cond_t *c, __mutex_t *m)
+{
+#ifdef _WIN32
+    SleepConditionVariableCS(c, m, INFINITE);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
 
+static void __cond_broadcast(__cond_t *c)
+{
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
 
-    for(y = 0; y < tmp->height; y++)
-    {
-        for(x = 0; x < tmp->width; x++)
-        {
+/* job system: every worker owns a deque of index ranges, takes work from the back of its own and steals from the front of
+   the others. slot 0 belongs to threads outside the pool, which help out while they wait in rafgl_parallel_for.
+   background batches (image loads) go to one shared queue that only the pool's threads pop, a waiter takes nothing
+   from it but the jobs of the batch it waits for */
 
-            r = 0;
-            g = 0;
-            b = 0;
-            for(offset = -radius; offset <= radius; offset++)
-            {
-                sampled = rafgl_point_sample(from, 1.0f * (x + offset) / (tmp->width), 1.0f * (y) / (tmp->height));
-                r += sampled.r;
-                g += sampled.g;
-                b += sampled.b;
-            }
+typedef struct __job_batch
+{
+    void (*fn)(int begin, int end, void *ctx);
+    void *ctx;
+    int remaining;
+} __job_batch_t;
+
+typedef struct __job
+{
+    __job_batch_t *batch;
+    int begin, end;
+} __job_t;
+
+typedef struct __job_deque
+{
+    __mutex_t lock;
+    __job_t *items;
+    int head, tail, capacity;
+} __job_deque_t;
 
-            resulting.r = r / sample_count;
-            resulting.g = g / sample_count;
-            resulting.b = b / sample_count;
+static struct
+{
+    int state;
+    int worker_count;
+    __job_deque_t *deques;
+    __job_deque_t background;
+    __thread_t *threads;
+    __mutex_t sleep_lock;
+    __cond_t wake;
+    int pending;
+    int shutdown;
+} __jobs;
+
+static __thread int __job_slot = 0;
+static __thread int __job_depth = 0;
+
+static void __deque_push(__job_deque_t *deque, __job_t job)
+{
+    __mutex_lock(&deque->lock);
 
-            pixel_at_pm(tmp, x, y) = resulting;
+    if(deque->tail == deque->capacity)
+    {
+        if(deque->head > 0)
+        {
+            memmove(deque->items, deque->items + deque->head, (deque->tail - deque->head) * sizeof(__job_t));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        }
+        else
+        {
+            deque->capacity = deque->capacity ? deque->capacity * 2 : 64;
+            deque->items = realloc(deque->items, deque->capacity * sizeof(__job_t));
         }
     }
 
-    for(y = 0; y < result->height; y++)
+    deque->items[deque->tail++] = job;
+    __mutex_unlock(&deque->lock);
+}
+
+static int __deque_take(__job_deque_t *deque, __job_t *job, int steal)
+{
+    int found = 0;
+
+    __mutex_lock(&deque->lock);
+    if(deque->head < deque->tail)
     {
-        for(x = 0; x < result->width; x++)
-        {
-            r = g = b = 0;
-            for(offset = -radius; offset <= radius; offset++)
-            {
-                sampled = rafgl_point_sample(tmp, 1.0f * (x) / result->width, 1.0f * (y + offset) / result->height);
-                r += sampled.r;
-                g += sampled.g;
-                b += sampled.b;
-            }
+        *job = steal ? deque->items[deque->head++] : deque->items[--deque->tail];
+        found = 1;
+        if(deque->head == deque->tail) deque->head = deque->tail = 0;
+    }
+    __mutex_unlock(&deque->lock);
 
-            resulting.r = r / sample_count;
-            resulting.g = g / sample_count;
-            resulting.b = b / sample_count;
+    return found;
+}
 
-            pixel_at_pm(result, x, y) = resulting;
-        }
+static int __jobs_take(int slot, __job_t *job)
+{
+    int i, found;
+
+    found = __deque_take(&__jobs.deques[slot], job, 0);
+    for(i = 1; !found && i < __jobs.worker_count; i++)
+    {
+        found = __deque_take(&__jobs.deques[(slot + i) % __jobs.worker_count], job, 1);
     }
+
+    if(found) __atomic_fetch_sub(&__jobs.pending, 1, __ATOMIC_ACQ_REL);
+    return found;
 }
 
-int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y, rafgl_pixel_rgb_t boja)
+/* oldest job in the background queue, only of the given batch unless it is NULL */
+static int __background_take(__job_t *job, __job_batch_t *batch)
 {
+    __job_deque_t *deque = &__jobs.background;
+    int i, found = 0;
 
-    int fl, fr, fu, fd;
-    int flc, frc, fuc, fdc;
-    int xi, yi;
+    __mutex_lock(&deque->lock);
+    for(i = deque->head; i < deque->tail; i++)
+    {
+        if(batch != NULL && deque->items[i].batch != batch) continue;
 
-    rafgl_pixel_rgb_t sampled;
+        *job = deque->items[i];
+        if(i == deque->head)
+            deque->head++;
+        else
+            memmove(deque->items + i, deque->items + i + 1, (--deque->tail - i) * sizeof(__job_t));
+        found = 1;
+        break;
+    }
+    if(deque->head == deque->tail) deque->head = deque->tail = 0;
+    __mutex_unlock(&deque->lock);
 
-    fl = x;
-    fr = x + from->width;//60
-    fu = y;
-    fd = y + from->height;//80
+    if(found) __atomic_fetch_sub(&__jobs.pending, 1, __ATOMIC_ACQ_REL);
+    return found;
+}
+
+static void __jobs_run(__job_t *job)
+{
+    __job_depth++;
+    job->batch->fn(job->begin, job->end, job->batch->ctx);
+    __job_depth--;
+
+    /* the batch lives on the waiting caller's stack (or in its rafgl_loader_t), it must not be touched after this */
+    __atomic_fetch_sub(&job->batch->remaining, 1, __ATOMIC_ACQ_REL);
+}
+
+static __thread_ret_t __THREAD_CALL __jobs_worker(void *arg)
+{
+    __job_t job;
+    int shutdown;
 
-    flc = rafgl_max_m(fl, 0);
-    frc = rafgl_min_m(fr, to->width);
-    fuc = rafgl_max_m(fu, 0);
-    fdc = rafgl_min_m(fd, to->height);
+    __job_slot = (int)(intptr_t)arg;
 
-    for(yi = fuc; yi < fdc; yi++)
+    while(1)
     {
-        for(xi = flc; xi < frc; xi++)
+        /* row jobs first, someone is waiting on those */
+        if(__jobs_take(__job_slot, &job) || __background_take(&job, NULL))
         {
-            sampled = pixel_at_pm(from, xi - fl, yi - fu);
-            if(sampled.rgba != RAFGL_COLOUR_KEY.rgba)
-            {
-
-                if(sampled.rgba == RAFGL_COLOUR_KEY_MOJ.rgba){// DODATO
-                    sampled = boja;
-                }
-                pixel_at_pm(to, xi, yi) = sampled;
-            }
+            __jobs_run(&job);
+            continue;
+        }
 
+        __mutex_lock(&__jobs.sleep_lock);
+        while(__atomic_load_n(&__jobs.pending, __ATOMIC_ACQUIRE) <= 0 && !__jobs.shutdown)
+        {
+            __cond_wait(&__jobs.wake, &__jobs.sleep_lock);
         }
-    }
+        shutdown = __jobs.shutdown;
+        __mutex_unlock(&__jobs.sleep_lock);
 
+        if(shutdown) break;
+    }
 
+    return 0;
 }
 
-/* Cohen-Sutherland line clipping algorithm constants */
-static const int __cohsuth_INSIDE = 0;     /* 0000 */
-static const int __cohsuth_LEFT   = 1;     /* 0001 */
-static const int __cohsuth_RIGHT  = 2;     /* 0010 */
-static const int __cohsuth_BOTTOM = 4;     /* 0100 */
-static const int __cohsuth_TOP    = 8;     /* 1000 */
-
-static int __compute_outcode(int x, int y, rafgl_raster_t *raster)
+int rafgl_jobs_init(int thread_count)
 {
-    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
-    int code = __cohsuth_INSIDE;
-    if(x < xmin)
+    int expected = 0, i;
+
+    if(!__atomic_compare_exchange_n(&__jobs.state, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
     {
-        code |= __cohsuth_LEFT;
+        /* already running, or another thread is starting it */
+        while(__atomic_load_n(&__jobs.state, __ATOMIC_ACQUIRE) == 1)
+            __thread_yield();
+        return 0;
     }
-    else if(x > xmax)
+
+    if(thread_count <= 0) thread_count = __cpu_count();
+
+    /* workers only ever read the kernel pointers */
+    __cpu_dispatch();
+
+    __jobs.worker_count = thread_count;
+    __jobs.deques = calloc(thread_count, sizeof(__job_deque_t));
+    __jobs.threads = calloc(thread_count, sizeof(__thread_t));
+    __jobs.pending = 0;
+    __jobs.shutdown = 0;
+    __mutex_init(&__jobs.sleep_lock);
+    __cond_init(&__jobs.wake);
+
+    for(i = 0; i < thread_count; i++)
     {
-        code |= __cohsuth_RIGHT;
+        __mutex_init(&__jobs.deques[i].lock);
     }
+    __mutex_init(&__jobs.background.lock);
 
-    if(y < ymin)
+    for(i = 1; i < thread_count; i++)
     {
-        code |= __cohsuth_BOTTOM;
+        if(__thread_create(&__jobs.threads[i], __jobs_worker, (void *)(intptr_t)i) != 0)
+        {
+            fprintf(stderr, "rafgl: started only %d of %d job threads\n", i - 1, thread_count - 1);
+            __jobs.worker_count = i;
+            break;
+        }
     }
-    else if(y > ymax)
+
+    __atomic_store_n(&__jobs.state, 2, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void rafgl_jobs_cleanup(void)
+{
+    int i, thread_count;
+
+    if(__atomic_load_n(&__jobs.state, __ATOMIC_ACQUIRE) != 2) return;
+
+    __mutex_lock(&__jobs.sleep_lock);
+    __jobs.shutdown = 1;
+    __cond_broadcast(&__jobs.wake);
+    __mutex_unlock(&__jobs.sleep_lock);
+
+    thread_count = __jobs.worker_count;
+    for(i = 1; i < thread_count; i++)
     {
-        code |= __cohsuth_TOP;
+        __thread_join(__jobs.threads[i]);
+    }
+
+    for(i = 0; i < thread_count; i++)
+    {
+        __mutex_destroy(&__jobs.deques[i].lock);
+        free(__jobs.deques[i].items);
+    }
+    __mutex_destroy(&__jobs.background.lock);
+    free(__jobs.background.items);
+    memset(&__jobs.background, 0, sizeof(__jobs.background));
+
+    __cond_destroy(&__jobs.wake);
+    __mutex_destroy(&__jobs.sleep_lock);
+    free(__jobs.deques);
+    free(__jobs.threads);
+    __jobs.deques = NULL;
+    __jobs.threads = NULL;
+    __jobs.worker_count = 0;
+
+    __atomic_store_n(&__jobs.state, 0, __ATOMIC_RELEASE);
+}
+
+int rafgl_jobs_thread_count(void)
+{
+    if(__atomic_load_n(&__jobs.state, __ATOMIC_ACQUIRE) == 2)
+        return __jobs.worker_count;
+    return __cpu_count();
+}
+
+/* queues count items in chunks of grain and returns at once. 0 means the batch could not be queued and nothing was run.
+   a single chunk is left to the caller. background batches are always queued, on the background queue */
+static int __jobs_submit(__job_batch_t *batch, int count, int grain, int background)
+{
+    __job_t job;
+    int chunks, i, slot = __job_slot;
+
+    chunks = (count + grain - 1) / grain;
+
+    /* nested calls run inline, the pool is already busy with the outer loop */
+    if((chunks == 1 && !background) || __job_depth > 0 || rafgl_jobs_init(0) != 0 || __jobs.worker_count <= 1)
+        return 0;
+
+    batch->remaining = chunks;
+
+    __atomic_fetch_add(&__jobs.pending, chunks, __ATOMIC_ACQ_REL);
+
+    /* neighbouring chunks go to the same worker, thieves take from the far end */
+    for(i = 0; i < chunks; i++)
+    {
+        job.batch = batch;
+        job.begin = i * grain;
+        job.end = rafgl_min_m(count, (i + 1) * grain);
+        if(background)
+            __deque_push(&__jobs.background, job);
+        else
+            __deque_push(&__jobs.deques[(slot + (int)((int64_t)i * __jobs.worker_count / chunks)) % __jobs.worker_count], job);
+    }
+
+    __mutex_lock(&__jobs.sleep_lock);
+    __cond_broadcast(&__jobs.wake);
+    __mutex_unlock(&__jobs.sleep_lock);
+
+    return 1;
+}
+
+/* helps run queued jobs until this one is finished. row jobs of any batch are fair game, background ones only if they are
+   this batch's, so a parallel_for inside a frame never ends up decoding an image */
+static void __jobs_wait(__job_batch_t *batch)
+{
+    __job_t job;
+
+    while(__atomic_load_n(&batch->remaining, __ATOMIC_ACQUIRE) > 0)
+    {
+        if(__jobs_take(__job_slot, &job) || __background_take(&job, batch))
+            __jobs_run(&job);
+        else
+            __thread_yield();
+    }
+}
+
+void rafgl_parallel_for(int count, int grain, void (*fn)(int begin, int end, void *ctx), void *ctx)
+{
+    __job_batch_t batch;
+
+    if(count <= 0) return;
+    if(grain < 1) grain = 1;
+
+    batch.fn = fn;
+    batch.ctx = ctx;
+
+    if(!__jobs_submit(&batch, count, grain, 0))
+    {
+        fn(0, count, ctx);
+        return;
+    }
+
+    __jobs_wait(&batch);
+}
+
+typedef struct __parallel_raster
+{
+    rafgl_raster_t *raster;
+    int tile_width, tile_height, tiles_per_row;
+    void (*rows)(rafgl_raster_t *raster, int y_begin, int y_end, void *ctx);
+    void (*tiles)(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, void *ctx);
+    void *ctx;
+} __parallel_raster_t;
+
+static void __parallel_rows_range(int begin, int end, void *ctx)
+{
+    __parallel_raster_t *p = ctx;
+    p->rows(p->raster, begin, end, p->ctx);
+}
+
+static void __parallel_tiles_range(int begin, int end, void *ctx)
+{
+    __parallel_raster_t *p = ctx;
+    int i, x0, y0;
+
+    for(i = begin; i < end; i++)
+    {
+        x0 = (i % p->tiles_per_row) * p->tile_width;
+        y0 = (i / p->tiles_per_row) * p->tile_height;
+        p->tiles(p->raster, x0, y0, rafgl_min_m(x0 + p->tile_width, p->raster->width), rafgl_min_m(y0 + p->tile_height, p->raster->height), p->ctx);
+    }
+}
+
+/* rows per job so that one job covers roughly this many pixels */
+#define __PARALLEL_JOB_PIXELS 16384
+
+void rafgl_parallel_for_rows(rafgl_raster_t *raster, void (*fn)(rafgl_raster_t *raster, int y_begin, int y_end, void *ctx), void *ctx)
+{
+    __parallel_raster_t p;
+
+    p.raster = raster;
+    p.rows = fn;
+    p.ctx = ctx;
+
+    rafgl_parallel_for(raster->height, __PARALLEL_JOB_PIXELS / rafgl_max_m(raster->width, 1), __parallel_rows_range, &p);
+}
+
+void rafgl_parallel_for_tiles(rafgl_raster_t *raster, int tile_width, int tile_height, void (*fn)(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, void *ctx), void *ctx)
+{
+    __parallel_raster_t p;
+
+    if(tile_width <= 0 || tile_height <= 0) return;
+
+    p.raster = raster;
+    p.tile_width = tile_width;
+    p.tile_height = tile_height;
+    p.tiles_per_row = (raster->width + tile_width - 1) / tile_width;
+    p.tiles = fn;
+    p.ctx = ctx;
+
+    rafgl_parallel_for(p.tiles_per_row * ((raster->height + tile_height - 1) / tile_height), 1, __parallel_tiles_range, &p);
+}
+
+
+static void *__aligned_malloc(size_t size)
+{
+    void *p;
+
+#ifdef _WIN32
+    p = _aligned_malloc(rafgl_max_m(size, 1), RAFGL_ROW_ALIGN);
+#else
+    if(posix_memalign(&p, RAFGL_ROW_ALIGN, rafgl_max_m(size, 1)) != 0) p = NULL;
+#endif
+
+    return p;
+}
+
+static void *__aligned_calloc(size_t size)
+{
+    void *p = __aligned_malloc(size);
+
+    if(p != NULL) memset(p, 0, size);
+    return p;
+}
+
+static void __aligned_free(void *p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+void *rafgl_frame_alloc(size_t size)
+{
+    void *block;
+
+    /* whole cache lines, so the next allocation stays aligned and threads writing neighbours never share a line */
+    size = (size + RAFGL_ROW_ALIGN - 1) / RAFGL_ROW_ALIGN * RAFGL_ROW_ALIGN;
+
+    if(__frame_arena.base == NULL && __frame_arena.used == 0)
+        rafgl_frame_arena_reserve(RAFGL_FRAME_ARENA_SIZE);
+
+    __frame_arena.used += size;
+    __frame_arena.high_water = rafgl_max_m(__frame_arena.high_water, __frame_arena.used);
+
+    if(__frame_arena.used <= __frame_arena.size)
+        return __frame_arena.base + __frame_arena.used - size;
+
+    /* spilled, the link to the previous spill sits in the line in front of the block */
+    block = __aligned_calloc(size + RAFGL_ROW_ALIGN);
+    if(block == NULL) return NULL;
+    *(void **)block = __frame_arena.spill;
+    __frame_arena.spill = block;
+    return (unsigned char *)block + RAFGL_ROW_ALIGN;
+}
+
+void rafgl_frame_arena_reset(void)
+{
+    void *next;
+
+    while(__frame_arena.spill != NULL)
+    {
+        next = *(void **)__frame_arena.spill;
+        __aligned_free(__frame_arena.spill);
+        __frame_arena.spill = next;
+    }
+
+    __frame_arena.used = 0;
+
+    /* the next frame like this one fits */
+    if(__frame_arena.high_water > __frame_arena.size)
+        rafgl_frame_arena_reserve(__frame_arena.high_water);
+}
+
+int rafgl_frame_arena_reserve(size_t size)
+{
+    unsigned char *base;
+
+    if(__frame_arena.used > 0) return -1;
+
+    base = __aligned_calloc(size);
+    if(base == NULL) return -1;
+
+    __aligned_free(__frame_arena.base);
+    __frame_arena.base = base;
+    __frame_arena.size = size;
+    return 0;
+}
+
+size_t rafgl_frame_arena_high_water(void)
+{
+    return __frame_arena.high_water;
+}
+
+/* scratch memory that only lives for one call */
+typedef struct __scratch
+{
+    size_t mark;
+    void *heap;
+} __scratch_t;
+
+/* inside a frame on the game loop's thread the scratch is carved from the frame arena and __scratch_end rewinds it, so
+   nothing piles up until the reset. anywhere else (init code, tools, other threads) it comes from the heap.
+   scratches end in the reverse order they began */
+static void *__scratch_begin(__scratch_t *scratch, size_t size)
+{
+    if(__frame_thread && __frame_arena.in_frame)
+    {
+        scratch->heap = NULL;
+        scratch->mark = __frame_arena.used;
+        return rafgl_frame_alloc(size);
+    }
+
+    scratch->heap = __aligned_malloc(size);
+    return scratch->heap;
+}
+
+static void __scratch_end(__scratch_t *scratch)
+{
+    /* a block that spilled to the heap stays on the spill list until the reset */
+    if(scratch->heap != NULL)
+        __aligned_free(scratch->heap);
+    else
+        __frame_arena.used = scratch->mark;
+}
+
+int rafgl_raster_init(rafgl_raster_t *raster, int width, int height)
+{
+    int row_pixels = RAFGL_ROW_ALIGN / sizeof(rafgl_pixel_rgb_t);
+
+    /* padding rows to whole cache lines keeps every row start aligned, and threads splitting a raster by rows never share a line */
+    raster->stride = (width + row_pixels - 1) / row_pixels * row_pixels;
+    raster->data = __aligned_calloc((size_t)raster->stride * height * sizeof(rafgl_pixel_rgb_t));
+    raster->width = width;
+    raster->height = height;
+    raster->spans = NULL;
+    raster->dirty = NULL;
+    raster->dirty_generation = 0;
+    raster->trim = NULL;
+    raster->borrowed = 0;
+    raster->parent = NULL;
+    raster->parent_x = raster->parent_y = 0;
+    raster->transient = 0;
+    raster->layout = RAFGL_LAYOUT_LINEAR;
+    rafgl_raster_set_clip(raster, 0, 0, width, height);
+    return 0;
+}
+
+int rafgl_raster_init_transient(rafgl_raster_t *raster, int width, int height)
+{
+    int row_pixels = RAFGL_ROW_ALIGN / sizeof(rafgl_pixel_rgb_t);
+
+    raster->stride = (width + row_pixels - 1) / row_pixels * row_pixels;
+    raster->data = rafgl_frame_alloc((size_t)raster->stride * height * sizeof(rafgl_pixel_rgb_t));
+    raster->width = width;
+    raster->height = height;
+    raster->spans = NULL;
+    raster->dirty = NULL;
+    raster->dirty_generation = 0;
+    raster->trim = NULL;
+    /* the arena takes the pixels back in one go */
+    raster->borrowed = 1;
+    raster->parent = NULL;
+    raster->parent_x = raster->parent_y = 0;
+    raster->transient = 1;
+    raster->layout = RAFGL_LAYOUT_LINEAR;
+    rafgl_raster_set_clip(raster, 0, 0, width, height);
+    return (raster->data != NULL) ? 0 : -1;
+}
+
+/* a raster over scratch memory for use inside one call, nothing to clean up but __scratch_end */
+static int __raster_init_scratch(rafgl_raster_t *raster, int width, int height, __scratch_t *scratch)
+{
+    int row_pixels = RAFGL_ROW_ALIGN / sizeof(rafgl_pixel_rgb_t);
+
+    raster->stride = (width + row_pixels - 1) / row_pixels * row_pixels;
+    raster->data = __scratch_begin(scratch, (size_t)raster->stride * height * sizeof(rafgl_pixel_rgb_t));
+    raster->width = width;
+    raster->height = height;
+    raster->spans = NULL;
+    raster->dirty = NULL;
+    raster->dirty_generation = 0;
+    raster->trim = NULL;
+    raster->borrowed = 1;
+    raster->parent = NULL;
+    raster->parent_x = raster->parent_y = 0;
+    raster->transient = 0;
+    raster->layout = RAFGL_LAYOUT_LINEAR;
+    rafgl_raster_set_clip(raster, 0, 0, width, height);
+    return (raster->data != NULL) ? 0 : -1;
+}
+
+int rafgl_raster_view(rafgl_raster_t *view, rafgl_raster_t *parent, int x, int y, int width, int height)
+{
+    int x0 = rafgl_clampi(x, 0, parent->width);
+    int y0 = rafgl_clampi(y, 0, parent->height);
+    int x1 = rafgl_clampi(x + width, x0, parent->width);
+    int y1 = rafgl_clampi(y + height, y0, parent->height);
+
+    /* a window into tiles is not a raster of its own */
+    if(parent->layout != RAFGL_LAYOUT_LINEAR) return -1;
+
+    /* same rows, started further in. rows stay cache line aligned only when x0 is a multiple of 16 */
+    view->data = &pixel_at_pm(parent, x0, y0);
+    view->stride = parent->stride;
+    view->width = x1 - x0;
+    view->height = y1 - y0;
+    view->spans = NULL;
+    view->dirty = NULL;
+    view->dirty_generation = 0;
+    view->trim = NULL;
+    view->borrowed = 1;
+    view->parent = parent;
+    view->parent_x = x0;
+    view->parent_y = y0;
+    view->transient = 0;
+    view->layout = RAFGL_LAYOUT_LINEAR;
+    rafgl_raster_set_clip(view, 0, 0, view->width, view->height);
+
+    return (view->width > 0 && view->height > 0) ? 0 : -1;
+}
+
+int rafgl_raster_init_tiled(rafgl_raster_t *raster, int width, int height)
+{
+    int tile_rows = (height + RAFGL_TILE_SIZE - 1) / RAFGL_TILE_SIZE;
+
+    /* the stride is a whole number of tiles already, the last tile row is allocated in full */
+    rafgl_raster_init(raster, width, tile_rows * RAFGL_TILE_SIZE);
+    raster->height = height;
+    raster->layout = RAFGL_LAYOUT_TILED;
+    rafgl_raster_set_clip(raster, 0, 0, width, height);
+    return 0;
+}
+
+typedef struct __relayout_job
+{
+    rafgl_raster_t *to, *from;
+    int clockwise;
+} __relayout_job_t;
+
+/* Z order position of the pixels of a tile row, see __tile_spread_m */
+static const uint8_t __tile_spread[RAFGL_TILE_SIZE] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+/* reads the w x h (at most a tile) block at (x0, y0) into block in its natural order: whole row pieces of a linear raster,
+   and a straight walk through the tile when the block is one */
+static void __block_read(rafgl_raster_t *r, int x0, int y0, int w, int h, rafgl_pixel_rgb_t block[RAFGL_TILE_SIZE][RAFGL_TILE_SIZE])
+{
+    int x, y;
+    rafgl_pixel_rgb_t *tile;
+
+    if(r->layout == RAFGL_LAYOUT_LINEAR)
+    {
+        for(y = 0; y < h; y++)
+            memcpy(block[y], &pixel_at_pm(r, x0, y0 + y), w * sizeof(rafgl_pixel_rgb_t));
+    }
+    else if(((x0 | y0) & (RAFGL_TILE_SIZE - 1)) == 0)
+    {
+        tile = &tiled_pixel_at_pm(r, x0, y0);
+        for(y = 0; y < h; y++)
+            for(x = 0; x < w; x++) block[y][x] = tile[__tile_spread[x] | (__tile_spread[y] << 1)];
+    }
+    else
+    {
+        for(y = 0; y < h; y++)
+            for(x = 0; x < w; x++) block[y][x] = tiled_pixel_at_pm(r, x0 + x, y0 + y);
+    }
+}
+
+static void __block_write(rafgl_raster_t *r, int x0, int y0, int w, int h, rafgl_pixel_rgb_t block[RAFGL_TILE_SIZE][RAFGL_TILE_SIZE])
+{
+    int x, y;
+    rafgl_pixel_rgb_t *tile;
+
+    if(r->layout == RAFGL_LAYOUT_LINEAR)
+    {
+        for(y = 0; y < h; y++)
+            memcpy(&pixel_at_pm(r, x0, y0 + y), block[y], w * sizeof(rafgl_pixel_rgb_t));
+    }
+    else if(((x0 | y0) & (RAFGL_TILE_SIZE - 1)) == 0)
+    {
+        tile = &tiled_pixel_at_pm(r, x0, y0);
+        for(y = 0; y < h; y++)
+            for(x = 0; x < w; x++) tile[__tile_spread[x] | (__tile_spread[y] << 1)] = block[y][x];
+    }
+    else
+    {
+        for(y = 0; y < h; y++)
+            for(x = 0; x < w; x++) tiled_pixel_at_pm(r, x0 + x, y0 + y) = block[y][x];
+    }
+}
+
+/* copies tile rows [begin, end) a tile at a time, both sides walked in memory order */
+static void __relayout_rows(int begin, int end, void *ctx)
+{
+    __relayout_job_t *job = ctx;
+    rafgl_raster_t *to = job->to, *from = job->from;
+    rafgl_pixel_rgb_t block[RAFGL_TILE_SIZE][RAFGL_TILE_SIZE];
+    int x, y, w, h;
+
+    for(y = begin * RAFGL_TILE_SIZE; y < rafgl_min_m(end * RAFGL_TILE_SIZE, from->height); y += RAFGL_TILE_SIZE)
+    {
+        h = rafgl_min_m(RAFGL_TILE_SIZE, from->height - y);
+
+        for(x = 0; x < from->width; x += RAFGL_TILE_SIZE)
+        {
+            w = rafgl_min_m(RAFGL_TILE_SIZE, from->width - x);
+            __block_read(from, x, y, w, h, block);
+            __block_write(to, x, y, w, h, block);
+        }
+    }
+}
+
+int rafgl_raster_copy_layout(rafgl_raster_t *to, rafgl_raster_t *from, int layout)
+{
+    __relayout_job_t job;
+
+    if(to->data == NULL)
+    {
+        if(layout == RAFGL_LAYOUT_TILED)
+            rafgl_raster_init_tiled(to, from->width, from->height);
+        else
+            rafgl_raster_init(to, from->width, from->height);
+    }
+    else if(to->width != from->width || to->height != from->height)
+    {
+        return -1;
+    }
+
+    job.to = to;
+    job.from = from;
+    rafgl_parallel_for((from->height + RAFGL_TILE_SIZE - 1) / RAFGL_TILE_SIZE, __PARALLEL_JOB_PIXELS / (RAFGL_TILE_SIZE * rafgl_max_m(from->width, 1)) + 1, __relayout_rows, &job);
+
+    rafgl_raster_mark_dirty(to, 0, 0, to->width, to->height);
+    return 0;
+}
+
+/* linear stand-in for raster inside one call of a kernel that walks rows: raster itself when it is linear, otherwise a scratch
+   copy, filled from raster only when read is set. NULL when the copy cannot be had */
+static rafgl_raster_t *__linear_begin(rafgl_raster_t *raster, rafgl_raster_t *copy, __scratch_t *scratch, int read)
+{
+    if(raster->layout == RAFGL_LAYOUT_LINEAR) return raster;
+
+    if(__raster_init_scratch(copy, raster->width, raster->height, scratch) != 0) return NULL;
+    if(read)
+        rafgl_raster_copy_layout(copy, raster, RAFGL_LAYOUT_LINEAR);
+    copy->clip = raster->clip;
+    return copy;
+}
+
+/* ends a __linear_begin, in reverse order like any scratch. a copy the call wrote into is put back into raster first */
+static void __linear_end(rafgl_raster_t *raster, rafgl_raster_t *linear, __scratch_t *scratch, int written)
+{
+    if(linear == raster || linear == NULL) return;
+
+    if(written)
+        rafgl_raster_copy_layout(raster, linear, RAFGL_LAYOUT_TILED);
+    __scratch_end(scratch);
+}
+
+/* fills destination tile rows [begin, end) a tile at a time. each tile comes from one 8x8 block of the source, which is
+   read and written in memory order and turned around in between, instead of reading 8 source rows for every destination row */
+static void __rotate_rows(int begin, int end, void *ctx)
+{
+    __relayout_job_t *job = ctx;
+    rafgl_raster_t *to = job->to, *from = job->from;
+    rafgl_pixel_rgb_t in[RAFGL_TILE_SIZE][RAFGL_TILE_SIZE], out[RAFGL_TILE_SIZE][RAFGL_TILE_SIZE];
+    int tx, ty, bw, bh, i, j;
+
+    for(; begin < end; begin++)
+    {
+        ty = begin * RAFGL_TILE_SIZE;
+        bh = rafgl_min_m(RAFGL_TILE_SIZE, to->height - ty);
+
+        for(tx = 0; tx < to->width; tx += RAFGL_TILE_SIZE)
+        {
+            bw = rafgl_min_m(RAFGL_TILE_SIZE, to->width - tx);
+
+            /* clockwise, (x, y) comes from (y, from->height - 1 - x), counterclockwise from (from->width - 1 - y, x) */
+            if(job->clockwise)
+            {
+                __block_read(from, ty, from->height - tx - bw, bh, bw, in);
+                for(j = 0; j < bh; j++)
+                    for(i = 0; i < bw; i++) out[j][i] = in[bw - 1 - i][j];
+            }
+            else
+            {
+                __block_read(from, from->width - ty - bh, tx, bh, bw, in);
+                for(j = 0; j < bh; j++)
+                    for(i = 0; i < bw; i++) out[j][i] = in[i][bh - 1 - j];
+            }
+
+            __block_write(to, tx, ty, bw, bh, out);
+        }
+    }
+}
+
+int rafgl_raster_rotate_90(rafgl_raster_t *to, rafgl_raster_t *from, int clockwise)
+{
+    __relayout_job_t job;
+
+    if(to->data == NULL)
+    {
+        if(from->layout == RAFGL_LAYOUT_TILED)
+            rafgl_raster_init_tiled(to, from->height, from->width);
+        else
+            rafgl_raster_init(to, from->height, from->width);
+    }
+    else if(to->width != from->height || to->height != from->width)
+    {
+        return -1;
+    }
+
+    job.to = to;
+    job.from = from;
+    job.clockwise = clockwise;
+    rafgl_parallel_for((to->height + RAFGL_TILE_SIZE - 1) / RAFGL_TILE_SIZE, __PARALLEL_JOB_PIXELS / (RAFGL_TILE_SIZE * rafgl_max_m(to->width, 1)) + 1, __rotate_rows, &job);
+
+    rafgl_raster_mark_dirty(to, 0, 0, to->width, to->height);
+    return 0;
+}
+
+int rafgl_raster_cleanup(rafgl_raster_t *raster)
+{
+    rafgl_raster_spans_cleanup(raster);
+    rafgl_raster_trim_cleanup(raster);
+    free(raster->dirty);
+    raster->dirty = NULL;
+    if(!raster->borrowed)
+        __aligned_free(raster->data);
+    raster->borrowed = 0;
+    raster->parent = NULL;
+    raster->transient = 0;
+    raster->height = 0;
+    raster->width = 0;
+    return 0;
+}
+
+static int __raster_load(rafgl_raster_t *raster, const char *image_path)
+{
+    int width, height, channels, y;
+    unsigned char *pixels = stbi_load(image_path, &width, &height, &channels, 4);
+
+    if(pixels == NULL)
+    {
+        rafgl_raster_init(raster, 0, 0);
+        __aligned_free(raster->data);
+        raster->data = NULL;
+        return -1;
+    }
+
+    /* stb_image rows are packed, the copy costs little next to the decode */
+    rafgl_raster_init(raster, width, height);
+    for(y = 0; y < height; y++)
+        memcpy(&pixel_at_pm(raster, 0, y), pixels + (size_t)y * width * sizeof(rafgl_pixel_rgb_t), width * sizeof(rafgl_pixel_rgb_t));
+
+    stbi_image_free(pixels);
+    return 0;
+}
+
+static int __raster_build_spans(rafgl_raster_t *raster, int cell_width)
+{
+    rafgl_span_cache_t *cache;
+    rafgl_span_t *grown;
+    int capacity = 64;
+    int x, y, c, cell_end, run_start, tinted;
+    uint32_t p, key = RAFGL_COLOUR_KEY.rgba, tint_key = RAFGL_COLOUR_KEY_MOJ.rgba;
+
+    rafgl_raster_spans_cleanup(raster);
+    if(raster->layout != RAFGL_LAYOUT_LINEAR) return -1;
+
+    /* an image that failed to load has no pixels and no frames */
+    if(raster->width <= 0 || raster->height <= 0 || cell_width <= 0) return -1;
+
+    cache = malloc(sizeof(rafgl_span_cache_t));
+    if(cache == NULL) return -1;
+    cache->cell_width = cell_width;
+    cache->cells_per_row = (raster->width + cell_width - 1) / cell_width;
+    cache->first = malloc((raster->height * cache->cells_per_row + 1) * sizeof(int));
+    cache->spans = malloc(capacity * sizeof(rafgl_span_t));
+    cache->span_count = 0;
+    if(cache->first == NULL || cache->spans == NULL)
+    {
+        free(cache->spans);
+        free(cache->first);
+        free(cache);
+        return -1;
+    }
+
+    for(y = 0; y < raster->height; y++)
+    {
+        for(c = 0; c < cache->cells_per_row; c++)
+        {
+            cache->first[y * cache->cells_per_row + c] = cache->span_count;
+            cell_end = rafgl_min_m((c + 1) * cell_width, raster->width);
+
+            x = c * cell_width;
+            while(x < cell_end)
+            {
+                p = pixel_at_pm(raster, x, y).rgba;
+                if(p == key)
+                {
+                    x++;
+                    continue;
+                }
+
+                /* plain and tinted pixels go into separate runs so plain ones can be copied as they are */
+                tinted = (p == tint_key);
+                run_start = x;
+                while(x < cell_end)
+                {
+                    p = pixel_at_pm(raster, x, y).rgba;
+                    if(p == key || (p == tint_key) != tinted) break;
+                    x++;
+                }
+
+                if(cache->span_count == capacity)
+                {
+                    capacity *= 2;
+                    grown = realloc(cache->spans, capacity * sizeof(rafgl_span_t));
+                    if(grown == NULL)
+                    {
+                        free(cache->spans);
+                        free(cache->first);
+                        free(cache);
+                        return -1;
+                    }
+                    cache->spans = grown;
+                }
+
+                cache->spans[cache->span_count].x = run_start;
+                cache->spans[cache->span_count].length = x - run_start;
+                cache->spans[cache->span_count].tinted = tinted;
+                cache->span_count++;
+            }
+        }
+    }
+    cache->first[raster->height * cache->cells_per_row] = cache->span_count;
+
+    raster->spans = cache;
+    return 0;
+}
+
+int rafgl_raster_build_spans(rafgl_raster_t *raster)
+{
+    return __raster_build_spans(raster, raster->width);
+}
+
+int rafgl_spritesheet_build_spans(rafgl_spritesheet_t *spritesheet)
+{
+    return __raster_build_spans(&(spritesheet->sheet), spritesheet->frame_width);
+}
+
+void rafgl_raster_spans_cleanup(rafgl_raster_t *raster)
+{
+    if(raster->spans == NULL) return;
+    free(raster->spans->first);
+    free(raster->spans->spans);
+    free(raster->spans);
+    raster->spans = NULL;
+}
+
+int rafgl_raster_trim(rafgl_raster_t *raster, int cell_width, int cell_height)
+{
+    rafgl_trim_t *trim;
+    rafgl_rect_t *box;
+    int cx, cy, x, y, x0, x1, y0, y1;
+    uint32_t key = RAFGL_COLOUR_KEY.rgba;
+
+    rafgl_raster_trim_cleanup(raster);
+
+    if(raster->layout != RAFGL_LAYOUT_LINEAR) return -1;
+    if(cell_width <= 0 || cell_height <= 0 || raster->width < cell_width || raster->height < cell_height) return -1;
+
+    trim = malloc(sizeof(rafgl_trim_t));
+    trim->cell_width = cell_width;
+    trim->cell_height = cell_height;
+    trim->cells_x = raster->width / cell_width;
+    trim->cells_y = raster->height / cell_height;
+    trim->boxes = malloc(trim->cells_x * trim->cells_y * sizeof(rafgl_rect_t));
+
+    for(cy = 0; cy < trim->cells_y; cy++)
+    {
+        for(cx = 0; cx < trim->cells_x; cx++)
+        {
+            x0 = cell_width;
+            y0 = cell_height;
+            x1 = y1 = 0;
+
+            for(y = 0; y < cell_height; y++)
+            {
+                for(x = 0; x < cell_width; x++)
+                {
+                    if(pixel_at_pm(raster, cx * cell_width + x, cy * cell_height + y).rgba == key) continue;
+
+                    x0 = rafgl_min_m(x0, x);
+                    x1 = rafgl_max_m(x1, x + 1);
+                    y0 = rafgl_min_m(y0, y);
+                    y1 = y + 1;
+                }
+            }
+
+            box = &trim->boxes[cy * trim->cells_x + cx];
+            box->x = (x1 > x0) ? x0 : 0;
+            box->y = (y1 > y0) ? y0 : 0;
+            box->width = rafgl_max_m(x1 - x0, 0);
+            box->height = rafgl_max_m(y1 - y0, 0);
+        }
+    }
+
+    raster->trim = trim;
+    return 0;
+}
+
+float rafgl_raster_trimmed_fraction(rafgl_raster_t *raster, int cell)
+{
+    rafgl_trim_t *trim = raster->trim;
+    int i, kept = 0, count;
+
+    if(trim == NULL) return 0.0f;
+
+    count = trim->cells_x * trim->cells_y;
+    if(cell >= count) return 0.0f;
+
+    if(cell >= 0)
+        return 1.0f - (float)(trim->boxes[cell].width * trim->boxes[cell].height) / (trim->cell_width * trim->cell_height);
+
+    for(i = 0; i < count; i++)
+        kept += trim->boxes[i].width * trim->boxes[i].height;
+
+    return 1.0f - (float)kept / (count * trim->cell_width * trim->cell_height);
+}
+
+void rafgl_raster_trim_cleanup(rafgl_raster_t *raster)
+{
+    if(raster->trim == NULL) return;
+    free(raster->trim->boxes);
+    free(raster->trim);
+    raster->trim = NULL;
+}
+
+/* narrows a w x h block lining up with a trim cell to the cell's opaque box, and moves the destination (x, y) along.
+   flips mirror the offset, since the box is walked backwards */
+static void __trim_block(rafgl_raster_t *from, int *src_x, int *src_y, int *w, int *h, int *x, int *y, int flags)
+{
+    rafgl_trim_t *trim = from->trim;
+    rafgl_rect_t *box;
+    int cx, cy;
+
+    if(trim == NULL || *w != trim->cell_width || *h != trim->cell_height || *src_x % *w != 0 || *src_y % *h != 0) return;
+
+    cx = *src_x / *w;
+    cy = *src_y / *h;
+    if(cx < 0 || cy < 0 || cx >= trim->cells_x || cy >= trim->cells_y) return;
+
+    box = &trim->boxes[cy * trim->cells_x + cx];
+
+    *x += (flags & RAFGL_FLIP_HORIZONTAL) ? *w - box->x - box->width : box->x;
+    *y += (flags & RAFGL_FLIP_VERTICAL) ? *h - box->y - box->height : box->y;
+    *src_x += box->x;
+    *src_y += box->y;
+    *w = box->width;
+    *h = box->height;
+}
+
+static int __rect_area(const rafgl_rect_t *r)
+{
+    return r->width * r->height;
+}
+
+static rafgl_rect_t __rect_union(const rafgl_rect_t *a, const rafgl_rect_t *b)
+{
+    rafgl_rect_t u;
+
+    u.x = rafgl_min_m(a->x, b->x);
+    u.y = rafgl_min_m(a->y, b->y);
+    u.width = rafgl_max_m(a->x + a->width, b->x + b->width) - u.x;
+    u.height = rafgl_max_m(a->y + a->height, b->y + b->height) - u.y;
+
+    return u;
+}
+
+/* adds the rectangle clipped to width x height */
+static void __dirty_list_add(rafgl_dirty_list_t *list, const rafgl_rect_t *area, int width, int height)
+{
+    rafgl_rect_t r, u;
+    int i, best = 0, growth, best_growth = INT_MAX;
+
+    r.x = rafgl_max_m(area->x, 0);
+    r.y = rafgl_max_m(area->y, 0);
+    r.width = rafgl_min_m(area->x + area->width, width) - r.x;
+    r.height = rafgl_min_m(area->y + area->height, height) - r.y;
+
+    if(r.width <= 0 || r.height <= 0) return;
+
+    for(i = 0; i < list->count; i++)
+    {
+        /* already covered, the common case when something is drawn over and over in the same place */
+        if(r.x >= list->rects[i].x && r.y >= list->rects[i].y && r.x + r.width <= list->rects[i].x + list->rects[i].width && r.y + r.height <= list->rects[i].y + list->rects[i].height)
+            return;
+    }
+
+    if(list->count < RAFGL_DIRTY_MAX_RECTS)
+    {
+        list->rects[list->count++] = r;
+        return;
+    }
+
+    /* out of room, grow whichever rectangle needs the fewest extra pixels to cover this one */
+    for(i = 0; i < list->count; i++)
+    {
+        u = __rect_union(&list->rects[i], &r);
+        growth = __rect_area(&u) - __rect_area(&list->rects[i]);
+        if(growth < best_growth)
+        {
+            best_growth = growth;
+            best = i;
+        }
+    }
+
+    list->rects[best] = __rect_union(&list->rects[best], &r);
+}
+
+static int __dirty_list_merge(rafgl_dirty_list_t *list)
+{
+    rafgl_rect_t u;
+    int i, j, merged;
+
+    /* two rectangles become one when their union wastes fewer pixels than another upload would cost */
+    do
+    {
+        merged = 0;
+        for(i = 0; i < list->count; i++)
+        {
+            for(j = i + 1; j < list->count; j++)
+            {
+                u = __rect_union(&list->rects[i], &list->rects[j]);
+                if(__rect_area(&u) <= __rect_area(&list->rects[i]) + __rect_area(&list->rects[j]) + RAFGL_DIRTY_MERGE_SLACK)
+                {
+                    list->rects[i] = u;
+                    list->rects[j] = list->rects[--list->count];
+                    merged = 1;
+                    j--;
+                }
+            }
+        }
+    } while(merged);
+
+    return list->count;
+}
+
+int rafgl_raster_track_dirty(rafgl_raster_t *raster)
+{
+    rafgl_rect_t whole;
+
+    if(raster->dirty == NULL)
+        raster->dirty = malloc(sizeof(rafgl_dirty_list_t));
+
+    /* nothing was written, so spans and trims stay */
+    whole.x = whole.y = 0;
+    whole.width = raster->width;
+    whole.height = raster->height;
+    raster->dirty->count = 0;
+    __dirty_list_add(raster->dirty, &whole, raster->width, raster->height);
+    return 0;
+}
+
+void rafgl_raster_mark_dirty(rafgl_raster_t *raster, int x, int y, int width, int height)
+{
+    rafgl_rect_t r;
+
+    /* the opaque boxes may have grown and the cached runs describe the old pixels, for the parents too */
+    rafgl_raster_trim_cleanup(raster);
+    rafgl_raster_spans_cleanup(raster);
+
+    if(raster->parent != NULL)
+    {
+        /* the pixels are the parent's, so is the upload that has to pick the write up */
+        x = rafgl_max_m(x, 0);
+        y = rafgl_max_m(y, 0);
+        width = rafgl_min_m(x + width, raster->width) - x;
+        height = rafgl_min_m(y + height, raster->height) - y;
+        if(width > 0 && height > 0)
+            rafgl_raster_mark_dirty(raster->parent, raster->parent_x + x, raster->parent_y + y, width, height);
+    }
+
+    if(raster->dirty == NULL) return;
+
+    r.x = x;
+    r.y = y;
+    r.width = width;
+    r.height = height;
+    __dirty_list_add(raster->dirty, &r, raster->width, raster->height);
+}
+
+int rafgl_raster_merge_dirty(rafgl_raster_t *raster)
+{
+    if(raster->dirty == NULL) return 0;
+    return __dirty_list_merge(raster->dirty);
+}
+
+void rafgl_raster_set_clip(rafgl_raster_t *raster, int x, int y, int width, int height)
+{
+    raster->clip.x = rafgl_max_m(x, 0);
+    raster->clip.y = rafgl_max_m(y, 0);
+    raster->clip.width = rafgl_max_m(rafgl_min_m(x + width, raster->width) - raster->clip.x, 0);
+    raster->clip.height = rafgl_max_m(rafgl_min_m(y + height, raster->height) - raster->clip.y, 0);
+}
+
+/* handed out by rafgl_raster_clear_dirty, never 0 so a freshly initialised raster matches no texture */
+static uint64_t __dirty_generation = 0;
+
+void rafgl_raster_clear_dirty(rafgl_raster_t *raster)
+{
+    if(raster->dirty != NULL)
+        raster->dirty->count = 0;
+    raster->dirty_generation = __atomic_add_fetch(&__dirty_generation, 1, __ATOMIC_RELAXED);
+}
+
+
+void rafgl_spritesheet_init(rafgl_spritesheet_t *spritesheet, const char *sheet_path, int sheet_width, int sheet_height)
+{
+    __raster_load(&(spritesheet->sheet), sheet_path);
+    spritesheet->sheet_width = sheet_width;
+    spritesheet->sheet_height = sheet_height;
+    spritesheet->frame_width = spritesheet->sheet.width / sheet_width;
+    spritesheet->frame_height = spritesheet->sheet.height / sheet_height;
+    rafgl_raster_trim(&(spritesheet->sheet), spritesheet->frame_width, spritesheet->frame_height);
+}
+
+int rafgl_spritesheet_frame_view(rafgl_raster_t *view, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y)
+{
+    return rafgl_raster_view(view, &(spritesheet->sheet), sheet_x * spritesheet->frame_width, sheet_y * spritesheet->frame_height, spritesheet->frame_width, spritesheet->frame_height);
+}
+
+/* colour keyed row copy: pixels equal to key are skipped, pixels equal to tint_key are replaced by tint.
+   passing tint_key == key disables the tint, since keyed pixels are rejected first */
+typedef void (*__blit_row_fn)(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint);
+
+static void __blit_row_keyed_scalar(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    int i;
+    uint32_t p;
+
+    for(i = 0; i < count; i++)
+    {
+        p = src[i].rgba;
+        if(p != key)
+        {
+            if(p == tint_key) p = tint;
+            dst[i].rgba = p;
+        }
+    }
+}
+
+#ifdef RAFGL_X86_SIMD
+
+__attribute__((target("sse2")))
+static void __blit_row_keyed_sse2(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    int i = 0;
+    __m128i k = _mm_set1_epi32((int)key);
+    __m128i tk = _mm_set1_epi32((int)tint_key);
+    __m128i t = _mm_set1_epi32((int)tint);
+    __m128i s, d, skip, tinted;
+
+    for(; i + 4 <= count; i += 4)
+    {
+        s = _mm_loadu_si128((const __m128i *)(src + i));
+        skip = _mm_cmpeq_epi32(s, k);
+
+        /* fully transparent quad, leave the destination untouched */
+        if(_mm_movemask_epi8(skip) == 0xffff) continue;
+
+        tinted = _mm_cmpeq_epi32(s, tk);
+        s = _mm_or_si128(_mm_and_si128(tinted, t), _mm_andnot_si128(tinted, s));
+
+        d = _mm_loadu_si128((const __m128i *)(dst + i));
+        d = _mm_or_si128(_mm_and_si128(skip, d), _mm_andnot_si128(skip, s));
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+
+    __blit_row_keyed_scalar(dst + i, src + i, count - i, key, tint_key, tint);
+}
+
+__attribute__((target("avx2")))
+static void __blit_row_keyed_avx2(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    int i = 0;
+    __m256i k = _mm256_set1_epi32((int)key);
+    __m256i tk = _mm256_set1_epi32((int)tint_key);
+    __m256i t = _mm256_set1_epi32((int)tint);
+    __m256i ones = _mm256_set1_epi32(-1);
+    __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i s, keep, tinted, live;
+
+    for(; i + 8 <= count; i += 8)
+    {
+        s = _mm256_loadu_si256((const __m256i *)(src + i));
+        keep = _mm256_xor_si256(_mm256_cmpeq_epi32(s, k), ones);
+
+        if(_mm256_testz_si256(keep, keep)) continue;
+
+        tinted = _mm256_cmpeq_epi32(s, tk);
+        s = _mm256_blendv_epi8(s, t, tinted);
+        _mm256_maskstore_epi32((int *)(dst + i), keep, s);
+    }
+
+    if(i < count)
+    {
+        /* tail: masked load and store, nothing past count is touched */
+        live = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lane);
+        s = _mm256_maskload_epi32((const int *)(src + i), live);
+        keep = _mm256_andnot_si256(_mm256_cmpeq_epi32(s, k), live);
+        tinted = _mm256_cmpeq_epi32(s, tk);
+        s = _mm256_blendv_epi8(s, t, tinted);
+        _mm256_maskstore_epi32((int *)(dst + i), keep, s);
+    }
+}
+
+#endif // RAFGL_X86_SIMD
+
+/* the widest kernel the CPU supports, set by __cpu_dispatch_init */
+static __blit_row_fn __blit_row_keyed_impl = __blit_row_keyed_scalar;
+
+static void __blit_row_keyed(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    if(count <= 0) return;
+
+    __cpu_dispatch();
+    __blit_row_keyed_impl(dst, src, count, key, tint_key, tint);
+}
+
+/* same as __blit_row_keyed, but walks the source backwards: dst[i] comes from src[-i] */
+static void __blit_row_keyed_reversed_scalar(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    int i;
+    uint32_t p;
+
+    for(i = 0; i < count; i++)
+    {
+        p = src[-i].rgba;
+        if(p != key)
+        {
+            if(p == tint_key) p = tint;
+            dst[i].rgba = p;
+        }
+    }
+}
+
+#ifdef RAFGL_X86_SIMD
+
+__attribute__((target("sse2")))
+static void __blit_row_keyed_reversed_sse2(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    int i = 0;
+    __m128i k = _mm_set1_epi32((int)key);
+    __m128i tk = _mm_set1_epi32((int)tint_key);
+    __m128i t = _mm_set1_epi32((int)tint);
+    __m128i s, d, skip, tinted;
+
+    for(; i + 4 <= count; i += 4)
+    {
+        s = _mm_loadu_si128((const __m128i *)(src - i - 3));
+        s = _mm_shuffle_epi32(s, _MM_SHUFFLE(0, 1, 2, 3));
+        skip = _mm_cmpeq_epi32(s, k);
+
+        if(_mm_movemask_epi8(skip) == 0xffff) continue;
+
+        tinted = _mm_cmpeq_epi32(s, tk);
+        s = _mm_or_si128(_mm_and_si128(tinted, t), _mm_andnot_si128(tinted, s));
+
+        d = _mm_loadu_si128((const __m128i *)(dst + i));
+        d = _mm_or_si128(_mm_and_si128(skip, d), _mm_andnot_si128(skip, s));
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+
+    __blit_row_keyed_reversed_scalar(dst + i, src - i, count - i, key, tint_key, tint);
+}
+
+#endif // RAFGL_X86_SIMD
+
+static __blit_row_fn __blit_row_keyed_reversed_impl = __blit_row_keyed_reversed_scalar;
+
+static void __blit_row_keyed_reversed(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src, int count, uint32_t key, uint32_t tint_key, uint32_t tint)
+{
+    if(count <= 0) return;
+
+    __cpu_dispatch();
+    __blit_row_keyed_reversed_impl(dst, src, count, key, tint_key, tint);
+}
+
+/* copies the cached opaque runs of one source row that fall inside [src_x0, src_x1) to dst, the first visible destination pixel.
+   when reversed, src_x1 - 1 lands on dst[0] and the runs are written backwards */
+static void __blit_row_spans(rafgl_pixel_rgb_t *dst, const rafgl_pixel_rgb_t *src_row, const rafgl_span_t *span, const rafgl_span_t *end, int src_x0, int src_x1, int reversed, int use_tint, uint32_t tint)
+{
+    int a, b, i;
+
+    for(; span < end && span->x < src_x1; span++)
+    {
+        a = rafgl_max_m(span->x, src_x0);
+        b = rafgl_min_m(span->x + span->length, src_x1);
+        if(a >= b) continue;
+
+        if(use_tint && span->tinted)
+        {
+            for(i = a; i < b; i++)
+                dst[reversed ? src_x1 - 1 - i : i - src_x0].rgba = tint;
+        }
+        else if(reversed)
+        {
+            for(i = a; i < b; i++)
+                dst[src_x1 - 1 - i] = src_row[i];
+        }
+        else
+        {
+            memcpy(dst + (a - src_x0), src_row + a, (b - a) * sizeof(rafgl_pixel_rgb_t));
+        }
+    }
+}
+
+/* blits covering at least this many destination pixels are split into bands of rows across the job system */
+#define __PARALLEL_BLIT_PIXELS 65536
+
+/* everything one row of a keyed blit needs, so bands of rows can run on different threads */
+typedef struct __keyed_blit
+{
+    rafgl_raster_t *to, *from;
+    rafgl_span_cache_t *cache;
+    int src_x, src_y, h, cell;
+    int fu, fuc, flc, frc, sx0, sx1;
+    int use_tint, flags;
+    uint32_t key, tint_key, tint;
+} __keyed_blit_t;
+
+static void __draw_keyed_rows(int begin, int end, void *ctx)
+{
+    __keyed_blit_t *b = ctx;
+    int yi, sy, row;
+    int hflip = (b->flags & RAFGL_FLIP_HORIZONTAL) != 0;
+    rafgl_span_cache_t *cache = b->cache;
+
+    for(yi = b->fuc + begin; yi < b->fuc + end; yi++)
+    {
+        sy = b->src_y + ((b->flags & RAFGL_FLIP_VERTICAL) ? b->h - 1 - (yi - b->fu) : yi - b->fu);
+
+        if(cache != NULL)
+        {
+            row = sy * cache->cells_per_row + b->cell;
+            __blit_row_spans(&pixel_at_pm(b->to, b->flc, yi), &pixel_at_pm(b->from, 0, sy), cache->spans + cache->first[row], cache->spans + cache->first[row + 1], b->src_x + b->sx0, b->src_x + b->sx1, hflip, b->use_tint, b->tint);
+        }
+        else if(hflip)
+        {
+            __blit_row_keyed_reversed(&pixel_at_pm(b->to, b->flc, yi), &pixel_at_pm(b->from, b->src_x + b->sx1 - 1, sy), b->frc - b->flc, b->key, b->tint_key, b->tint);
+        }
+        else
+        {
+            __blit_row_keyed(&pixel_at_pm(b->to, b->flc, yi), &pixel_at_pm(b->from, b->src_x + b->sx0, sy), b->frc - b->flc, b->key, b->tint_key, b->tint);
+        }
+    }
+}
+
+/* colour keyed blit of the w x h block at (src_x, src_y) in from to (x, y) in to. cell is the span cache column the block
+   occupies, or -1 when the cache does not line up with the block. flips only change the direction the source is walked in */
+static void __draw_keyed(rafgl_raster_t *to, rafgl_raster_t *from, int src_x, int src_y, int w, int h, int cell, int x, int y, int use_tint, uint32_t tint, int flags)
+{
+    int fl, fr, fd, fdc;
+    __keyed_blit_t b;
+    rafgl_raster_t to_copy, from_copy, *to_linear, *from_linear;
+    __scratch_t to_scratch, from_scratch;
+
+    if(to->layout != RAFGL_LAYOUT_LINEAR || from->layout != RAFGL_LAYOUT_LINEAR)
+    {
+        /* the row kernels need linear rows, a tiled side goes through a copy of the whole raster */
+        from_linear = __linear_begin(from, &from_copy, &from_scratch, 1);
+        to_linear = (from_linear != NULL) ? __linear_begin(to, &to_copy, &to_scratch, 1) : NULL;
+        if(to_linear != NULL)
+            __draw_keyed(to_linear, from_linear, src_x, src_y, w, h, (from_linear == from) ? cell : -1, x, y, use_tint, tint, flags);
+        __linear_end(to, to_linear, &to_scratch, 1);
+        __linear_end(from, from_linear, &from_scratch, 0);
+        return;
+    }
+
+    __trim_block(from, &src_x, &src_y, &w, &h, &x, &y, flags);
+
+    b.to = to;
+    b.from = from;
+    b.cache = (cell >= 0) ? from->spans : NULL;
+    b.src_x = src_x;
+    b.src_y = src_y;
+    b.h = h;
+    b.cell = cell;
+    b.use_tint = use_tint;
+    b.flags = flags;
+    b.key = RAFGL_COLOUR_KEY.rgba;
+    b.tint_key = use_tint ? RAFGL_COLOUR_KEY_MOJ.rgba : b.key;
+    b.tint = tint;
+
+    fl = x;
+    fr = x + w;
+    b.fu = y;
+    fd = y + h;
+
+    b.flc = rafgl_max_m(fl, to->clip.x);
+    b.frc = rafgl_min_m(fr, to->clip.x + to->clip.width);
+    b.fuc = rafgl_max_m(b.fu, to->clip.y);
+    fdc = rafgl_min_m(fd, to->clip.y + to->clip.height);
+
+    if(b.flc >= b.frc || b.fuc >= fdc) return;
+
+    rafgl_raster_mark_dirty(to, b.flc, b.fuc, b.frc - b.flc, fdc - b.fuc);
+
+    /* visible source columns, relative to src_x */
+    if(flags & RAFGL_FLIP_HORIZONTAL)
+    {
+        b.sx0 = w - (b.frc - fl);
+        b.sx1 = w - (b.flc - fl);
+    }
+    else
+    {
+        b.sx0 = b.flc - fl;
+        b.sx1 = b.frc - fl;
+    }
+
+    if((fdc - b.fuc) * (b.frc - b.flc) >= __PARALLEL_BLIT_PIXELS)
+        rafgl_parallel_for(fdc - b.fuc, __PARALLEL_JOB_PIXELS / (b.frc - b.flc), __draw_keyed_rows, &b);
+    else
+        __draw_keyed_rows(0, fdc - b.fuc, &b);
+}
+
+void rafgl_raster_draw_spritesheet(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y)
+{
+    rafgl_raster_draw_spritesheet_flipped(raster, spritesheet, sheet_x, sheet_y, x, y, 0);
+}
+
+void rafgl_raster_draw_spritesheet_flipped(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, int flags)
+{
+    rafgl_span_cache_t *cache = spritesheet->sheet.spans;
+    int cell = -1;
+
+    if(cache != NULL && cache->cell_width == spritesheet->frame_width && sheet_x < cache->cells_per_row)
+        cell = sheet_x;
+
+    __draw_keyed(raster, &(spritesheet->sheet), sheet_x * spritesheet->frame_width, sheet_y * spritesheet->frame_height, spritesheet->frame_width, spritesheet->frame_height, cell, x, y, 0, 0, flags);
+}
+
+
+/* samples the w x h block at 16.16 fixed point (u, v) into out, returns 0 when the sample is colour keyed */
+static int __sample_scaled(rafgl_raster_t *from, int src_x, int src_y, int w, int h, int u, int v, int filter, rafgl_pixel_rgb_t *out)
+{
+    int x0, y0, x1, y1, wx, wy, c, top, bottom;
+    uint32_t key = RAFGL_COLOUR_KEY.rgba;
+    rafgl_pixel_rgb_t nearest, taps[4];
+
+    if(filter != RAFGL_SAMPLE_BILINEAR)
+    {
+        x0 = rafgl_min_m(u >> 16, w - 1);
+        y0 = rafgl_min_m(v >> 16, h - 1);
+        nearest = pixel_at_pm(from, src_x + x0, src_y + y0);
+        if(nearest.rgba == key) return 0;
+        *out = nearest;
+        return 1;
+    }
+
+    /* texel centres sit on half coordinates */
+    u = rafgl_clampi(u - 32768, 0, (w - 1) << 16);
+    v = rafgl_clampi(v - 32768, 0, (h - 1) << 16);
+
+    x0 = u >> 16;
+    y0 = v >> 16;
+    x1 = rafgl_min_m(x0 + 1, w - 1);
+    y1 = rafgl_min_m(y0 + 1, h - 1);
+    wx = (u >> 8) & 0xff;
+    wy = (v >> 8) & 0xff;
+
+    /* coverage comes from the nearest texel, keyed neighbours are replaced by it so the key colour never bleeds in */
+    nearest = pixel_at_pm(from, src_x + (wx < 128 ? x0 : x1), src_y + (wy < 128 ? y0 : y1));
+    if(nearest.rgba == key) return 0;
+
+    taps[0] = pixel_at_pm(from, src_x + x0, src_y + y0);
+    taps[1] = pixel_at_pm(from, src_x + x1, src_y + y0);
+    taps[2] = pixel_at_pm(from, src_x + x0, src_y + y1);
+    taps[3] = pixel_at_pm(from, src_x + x1, src_y + y1);
+
+    for(c = 0; c < 4; c++)
+    {
+        if(taps[c].rgba == key) taps[c] = nearest;
+    }
+
+    for(c = 0; c < 4; c++)
+    {
+        top = taps[0].components[c] * (256 - wx) + taps[1].components[c] * wx;
+        bottom = taps[2].components[c] * (256 - wx) + taps[3].components[c] * wx;
+        out->components[c] = (top * (256 - wy) + bottom * wy) >> 16;
+    }
+
+    return 1;
+}
+
+typedef struct __scaled_blit
+{
+    rafgl_raster_t *to, *from;
+    int src_x, src_y, w, h;
+    int x, y, dw, dh;
+    int flc, frc, fuc;
+    int step_x, step_y;
+    int filter, flags;
+} __scaled_blit_t;
+
+static void __draw_scaled_rows(int begin, int end, void *ctx)
+{
+    __scaled_blit_t *b = ctx;
+    int xi, yi, lx, ly, u, v;
+    rafgl_pixel_rgb_t sampled;
+
+    for(yi = b->fuc + begin; yi < b->fuc + end; yi++)
+    {
+        ly = yi - b->y;
+        if(b->flags & RAFGL_FLIP_VERTICAL) ly = b->dh - 1 - ly;
+        v = ly * b->step_y + b->step_y / 2;
+
+        for(xi = b->flc; xi < b->frc; xi++)
+        {
+            lx = xi - b->x;
+            if(b->flags & RAFGL_FLIP_HORIZONTAL) lx = b->dw - 1 - lx;
+            u = lx * b->step_x + b->step_x / 2;
+
+            if(__sample_scaled(b->from, b->src_x, b->src_y, b->w, b->h, u, v, b->filter, &sampled))
+                pixel_at_pm(b->to, xi, yi) = sampled;
+        }
+    }
+}
+
+/* colour keyed blit of the w x h block at (src_x, src_y) in from, stretched to dw x dh at (x, y) in to */
+static void __draw_scaled(rafgl_raster_t *to, rafgl_raster_t *from, int src_x, int src_y, int w, int h, int x, int y, int dw, int dh, int filter, int flags)
+{
+    int fdc;
+    __scaled_blit_t b;
+    rafgl_raster_t to_copy, from_copy, *to_linear, *from_linear;
+    __scratch_t to_scratch, from_scratch;
+
+    if(dw <= 0 || dh <= 0 || w <= 0 || h <= 0) return;
+    if(to->layout != RAFGL_LAYOUT_LINEAR || from->layout != RAFGL_LAYOUT_LINEAR)
+    {
+        from_linear = __linear_begin(from, &from_copy, &from_scratch, 1);
+        to_linear = (from_linear != NULL) ? __linear_begin(to, &to_copy, &to_scratch, 1) : NULL;
+        if(to_linear != NULL)
+            __draw_scaled(to_linear, from_linear, src_x, src_y, w, h, x, y, dw, dh, filter, flags);
+        __linear_end(to, to_linear, &to_scratch, 1);
+        __linear_end(from, from_linear, &from_scratch, 0);
+        return;
+    }
+
+    b.to = to;
+    b.from = from;
+    b.src_x = src_x;
+    b.src_y = src_y;
+    b.w = w;
+    b.h = h;
+    b.x = x;
+    b.y = y;
+    b.dw = dw;
+    b.dh = dh;
+    b.filter = filter;
+    b.flags = flags;
+
+    b.flc = rafgl_max_m(x, to->clip.x);
+    b.frc = rafgl_min_m(x + dw, to->clip.x + to->clip.width);
+    b.fuc = rafgl_max_m(y, to->clip.y);
+    fdc = rafgl_min_m(y + dh, to->clip.y + to->clip.height);
+
+    if(b.flc >= b.frc || b.fuc >= fdc) return;
+
+    rafgl_raster_mark_dirty(to, b.flc, b.fuc, b.frc - b.flc, fdc - b.fuc);
+
+    b.step_x = (int)(((int64_t)w << 16) / dw);
+    b.step_y = (int)(((int64_t)h << 16) / dh);
+
+    if((fdc - b.fuc) * (b.frc - b.flc) >= __PARALLEL_BLIT_PIXELS)
+        rafgl_parallel_for(fdc - b.fuc, __PARALLEL_JOB_PIXELS / (b.frc - b.flc), __draw_scaled_rows, &b);
+    else
+        __draw_scaled_rows(0, fdc - b.fuc, &b);
+}
+
+void rafgl_raster_draw_spritesheet_scaled(rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_x, int sheet_y, int x, int y, int width, int height, int filter, int flags)
+{
+    __draw_scaled(raster, &(spritesheet->sheet), sheet_x * spritesheet->frame_width, sheet_y * spritesheet->frame_height, spritesheet->frame_width, spritesheet->frame_height, x, y, width, height, filter, flags);
+}
+
+
+int rafgl_raster_copy(rafgl_raster_t *raster_to, rafgl_raster_t *raster_from)
+{
+    int y;
+
+    if(raster_from->layout != RAFGL_LAYOUT_LINEAR || (raster_to->data != NULL && raster_to->layout != RAFGL_LAYOUT_LINEAR))
+        return rafgl_raster_copy_layout(raster_to, raster_from, raster_to->data != NULL ? raster_to->layout : raster_from->layout);
+
+    if(raster_to->data == NULL)
+    {
+        /* new raster */
+        rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+    }
+    else if(raster_to -> width != raster_from -> width || raster_to -> height != raster_from -> height)
+    {
+        /* a view cannot grow out of its parent */
+        if(raster_to->parent != NULL) return -1;
+
+        /* resize, dirty tracking survives it and transient rasters stay in the frame arena */
+        rafgl_dirty_list_t *dirty = raster_to->dirty;
+        int transient = raster_to->transient;
+        raster_to->dirty = NULL;
+        rafgl_raster_cleanup(raster_to);
+        if(transient)
+            rafgl_raster_init_transient(raster_to, raster_from->width, raster_from->height);
+        else
+            rafgl_raster_init(raster_to, raster_from->width, raster_from->height);
+        raster_to->dirty = dirty;
+    }
+
+    /* just copy, a row at a time when the strides differ or either row tail belongs to a parent's pixels */
+    if(raster_to->stride == raster_from->stride && raster_to->parent == NULL && raster_from->parent == NULL)
+        memcpy(raster_to->data, raster_from->data, (size_t)raster_from->stride * raster_from->height * sizeof(rafgl_pixel_rgb_t));
+    else
+        for(y = 0; y < raster_from->height; y++)
+            memcpy(&pixel_at_pm(raster_to, 0, y), &pixel_at_pm(raster_from, 0, y), raster_from->width * sizeof(rafgl_pixel_rgb_t));
+    rafgl_raster_mark_dirty(raster_to, 0, 0, raster_to->width, raster_to->height);
+    return 0;
+}
+
+int rafgl_raster_load_from_image(rafgl_raster_t *raster, const char *image_path)
+{
+    if(__raster_load(raster, image_path) != 0) return -1;
+    rafgl_raster_trim(raster, raster->width, raster->height);
+    return 0;
+}
+
+int rafgl_raster_save_to_png(rafgl_raster_t *raster, const char *image_path)
+{
+    rafgl_raster_t linear;
+    int result;
+
+    if(raster->layout == RAFGL_LAYOUT_LINEAR)
+        return stbi_write_png(image_path, raster->width, raster->height, 4, raster->data, raster->stride * sizeof(rafgl_pixel_rgb_t));
+
+    linear.data = NULL;
+    rafgl_raster_copy_layout(&linear, raster, RAFGL_LAYOUT_LINEAR);
+    result = rafgl_raster_save_to_png(&linear, image_path);
+    rafgl_raster_cleanup(&linear);
+    return result;
+}
+
+typedef struct __box_blur_job
+{
+    rafgl_raster_t *result, *tmp, *from;
+    int radius;
+    /* window sums of the vertical pass, 4 per column */
+    int *sums;
+} __box_blur_job_t;
+
+/* columns per block of the vertical pass, the running sums of one block stay in L1 */
+#define __BOX_BLUR_BLOCK 64
+
+/* horizontal pass over rows [y_begin, y_end): a sliding window sum, one add and one subtract per pixel regardless of the radius */
+static void __box_blur_rows(int y_begin, int y_end, void *ctx)
+{
+    __box_blur_job_t *job = ctx;
+    int x, y, c, w = job->from->width, r = job->radius, n = 2 * r + 1;
+    int sum[4];
+    rafgl_pixel_rgb_t *row, *out, add, sub;
+
+    for(y = y_begin; y < y_end; y++)
+    {
+        row = &pixel_at_pm(job->from, 0, y);
+        out = &pixel_at_pm(job->tmp, 0, y);
+
+        sum[0] = sum[1] = sum[2] = sum[3] = 0;
+        for(x = -r; x <= r; x++)
+        {
+            add = row[rafgl_clampi(x, 0, w - 1)];
+            for(c = 0; c < 4; c++) sum[c] += add.components[c];
+        }
+
+        for(x = 0; x < w; x++)
+        {
+            for(c = 0; c < 4; c++) out[x].components[c] = sum[c] / n;
+
+            add = row[rafgl_min_m(x + r + 1, w - 1)];
+            sub = row[rafgl_max_m(x - r, 0)];
+            for(c = 0; c < 4; c++) sum[c] += add.components[c] - sub.components[c];
+        }
+    }
+}
+
+static void __box_blur_add_row(int *sums, const rafgl_pixel_rgb_t *row, int count, int sign)
+{
+    int i;
+    const uint8_t *p = (const uint8_t *)row;
+
+    for(i = 0; i < 4 * count; i++)
+    {
+        sums[i] += sign * p[i];
+    }
+}
+
+/* vertical pass over column blocks [block_begin, block_end): the window sums of a whole block slide down one row at a time,
+   so memory is still walked row by row */
+static void __box_blur_columns(int block_begin, int block_end, void *ctx)
+{
+    __box_blur_job_t *job = ctx;
+    int x0 = block_begin * __BOX_BLUR_BLOCK;
+    int x1 = rafgl_min_m(block_end * __BOX_BLUR_BLOCK, job->tmp->width);
+    int h = job->tmp->height, r = job->radius, n = 2 * r + 1;
+    int count = x1 - x0, i, y;
+    int *sums;
+    uint8_t *out;
+
+    if(count <= 0) return;
+
+    sums = job->sums + 4 * x0;
+    memset(sums, 0, 4 * count * sizeof(int));
+
+    for(y = -r; y <= r; y++)
+    {
+        __box_blur_add_row(sums, &pixel_at_pm(job->tmp, x0, rafgl_clampi(y, 0, h - 1)), count, 1);
+    }
+
+    for(y = 0; y < h; y++)
+    {
+        out = (uint8_t *)&pixel_at_pm(job->result, x0, y);
+        for(i = 0; i < 4 * count; i++) out[i] = sums[i] / n;
+
+        __box_blur_add_row(sums, &pixel_at_pm(job->tmp, x0, rafgl_min_m(y + r + 1, h - 1)), count, 1);
+        __box_blur_add_row(sums, &pixel_at_pm(job->tmp, x0, rafgl_max_m(y - r, 0)), count, -1);
+    }
+}
+
+void rafgl_raster_box_blur(rafgl_raster_t *result, rafgl_raster_t *tmp, rafgl_raster_t *from, int radius)
+{
+    __box_blur_job_t job;
+    rafgl_raster_t horizontal;
+    __scratch_t tmp_scratch, sums_scratch;
+    rafgl_raster_t result_copy, tmp_copy, from_copy, *result_linear, *tmp_linear, *from_linear;
+    __scratch_t result_scratch, from_scratch;
+
+    if(result->layout != RAFGL_LAYOUT_LINEAR || from->layout != RAFGL_LAYOUT_LINEAR || (tmp != NULL && tmp->layout != RAFGL_LAYOUT_LINEAR))
+    {
+        /* both passes walk rows, tiled rasters go through copies of the whole raster. result and tmp are only written */
+        from_linear = __linear_begin(from, &from_copy, &from_scratch, 1);
+        tmp_linear = (tmp != NULL && from_linear != NULL) ? __linear_begin(tmp, &tmp_copy, &tmp_scratch, 0) : NULL;
+        result_linear = (from_linear != NULL && (tmp == NULL || tmp_linear != NULL)) ? __linear_begin(result, &result_copy, &result_scratch, 0) : NULL;
+        if(result_linear != NULL)
+            rafgl_raster_box_blur(result_linear, tmp_linear, from_linear, radius);
+        __linear_end(result, result_linear, &result_scratch, 1);
+        if(tmp != NULL)
+            __linear_end(tmp, tmp_linear, &tmp_scratch, result_linear != NULL);
+        __linear_end(from, from_linear, &from_scratch, 0);
+        return;
+    }
+
+    if(tmp == NULL)
+    {
+        __raster_init_scratch(&horizontal, from->width, from->height, &tmp_scratch);
+        tmp = &horizontal;
+    }
+
+    job.result = result;
+    job.tmp = tmp;
+    job.from = from;
+    job.radius = rafgl_max_m(radius, 0);
+    /* taken here, the workers must not touch the arena */
+    job.sums = __scratch_begin(&sums_scratch, 4 * tmp->width * sizeof(int));
+
+    rafgl_parallel_for(from->height, __PARALLEL_JOB_PIXELS / rafgl_max_m(from->width, 1), __box_blur_rows, &job);
+    rafgl_parallel_for((tmp->width + __BOX_BLUR_BLOCK - 1) / __BOX_BLUR_BLOCK, 1, __box_blur_columns, &job);
+
+    rafgl_raster_mark_dirty(tmp, 0, 0, tmp->width, tmp->height);
+    rafgl_raster_mark_dirty(result, 0, 0, result->width, result->height);
+
+    __scratch_end(&sums_scratch);
+    if(tmp == &horizontal)
+        __scratch_end(&tmp_scratch);
+}
+
+int rafgl_raster_draw_raster(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y, rafgl_pixel_rgb_t boja)
+{
+    return rafgl_raster_draw_raster_flipped(to, from, x, y, boja, 0);
+}
+
+int rafgl_raster_draw_raster_flipped(rafgl_raster_t *to, rafgl_raster_t *from, int x, int y, rafgl_pixel_rgb_t boja, int flags)
+{
+    int cell = (from->spans != NULL && from->spans->cells_per_row == 1) ? 0 : -1;
+
+    /* keyed pixels are skipped, RAFGL_COLOUR_KEY_MOJ pixels are replaced by boja, several pixels per instruction where the CPU allows */
+    __draw_keyed(to, from, 0, 0, from->width, from->height, cell, x, y, 1, boja.rgba, flags);
+    return 0;
+}
+
+/* Cohen-Sutherland line clipping algorithm constants */
+static const int __cohsuth_INSIDE = 0;     /* 0000 */
+static const int __cohsuth_LEFT   = 1;     /* 0001 */
+static const int __cohsuth_RIGHT  = 2;     /* 0010 */
+static const int __cohsuth_BOTTOM = 4;     /* 0100 */
+static const int __cohsuth_TOP    = 8;     /* 1000 */
+
+static int __compute_outcode(int x, int y, rafgl_raster_t *raster)
+{
+    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
+    int code = __cohsuth_INSIDE;
+    if(x < xmin)
+    {
+        code |= __cohsuth_LEFT;
+    }
+    else if(x > xmax)
+    {
+        code |= __cohsuth_RIGHT;
+    }
+
+    if(y < ymin)
+    {
+        code |= __cohsuth_BOTTOM;
+    }
+    else if(y > ymax)
+    {
+        code |= __cohsuth_TOP;
+    }
+
+    return code;
+}
+
+void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
+{
+
+    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
+    int outcode0 = __compute_outcode(x0, y0, raster);
+    int outcode1 = __compute_outcode(x1, y1, raster);
+    int accept = 0;
+    int xnew, ynew;
+    int outside_outcode;
+
+    while(1)
+    {
+
+        if(!(outcode0 | outcode1))
+        {
+            /* trivijalno prihvatanje */
+            accept = 1;
+            break;
+        }
+        else if(outcode0 & outcode1)
+        {
+            /* trivijalno odbacivanje */
+            break;
+        }
+        else
+        {
+            outside_outcode = outcode0 ? outcode0 : outcode1;
+            if(outside_outcode & __cohsuth_TOP)
+            {
+                xnew = x0 + (x1 - x0) * (ymax - y0) / (y1 - y0);
+                ynew = ymax;
+            }
+            else if(outside_outcode & __cohsuth_BOTTOM)
+            {
+                xnew = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
+				ynew = ymin;
+            }
+            else if (outside_outcode & __cohsuth_RIGHT)
+            {
+				ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
+				xnew = xmax;
+			}
+			else if (outside_outcode & __cohsuth_LEFT)
+            {
+				ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
+				xnew = xmin;
+			}
+
+			if(outside_outcode == outcode0)
+            {
+                x0 = xnew;
+                y0 = ynew;
+                outcode0 = __compute_outcode(x0, y0, raster);
+            }
+            else
+            {
+                x1 = xnew;
+                y1 = ynew;
+                outcode1 = __compute_outcode(x1, y1, raster);
+            }
+        }
+
+
+    }
+
+
+    if(!accept)
+        return;
+
+    x0 = rafgl_clampi(x0, 0, xmax);
+    y0 = rafgl_clampi(y0, 0, ymax);
+    x1 = rafgl_clampi(x1, 0, xmax);
+    y1 = rafgl_clampi(y1, 0, ymax);
+
+    rafgl_raster_mark_dirty(raster, rafgl_min_m(x0, x1), rafgl_min_m(y0, y1), rafgl_abs_m((x1 - x0)) + 1, rafgl_abs_m((y1 - y0)) + 1);
+
+    /* printf("---\nx0: %d\ny0: %d\nx1: %d\ny1: %d\n", x0, y0, x1, y1); */
+
+    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
+    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
+    int err = dx+dy, e2; /* error value e_xy */
+
+    while(1)
+    {
+        layout_pixel_at_pm(raster, x0, y0).rgba = colour;
+        if (x0==x1 && y0==y1) break;
+        e2 = 2*err;
+        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
+        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
+    }
+
+}
+
+/* DOES NOT DO CLIPPING! */
+void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour)
+{
+    int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */
+    rafgl_raster_mark_dirty(raster, cx - r, cy - r, 2 * r + 1, 2 * r + 1);
+    do {
+        layout_pixel_at_pm(raster, cx-x, cy+y).rgba = colour; /*   I. Quadrant */
+        layout_pixel_at_pm(raster, cx-y, cy-x).rgba = colour; /*  II. Quadrant */
+        layout_pixel_at_pm(raster, cx+x, cy-y).rgba = colour; /* III. Quadrant */
+        layout_pixel_at_pm(raster, cx+y, cy+x).rgba = colour; /*  IV. Quadrant */
+        r = err;
+        if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
+        if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
+    } while (x < 0);
+}
+
+void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour)
+{
+    rafgl_raster_draw_line(raster, x0, y0, x0 + w, y0, colour);
+    rafgl_raster_draw_line(raster, x0, y0 + h, x0 + w, y0 + h, colour);
+    rafgl_raster_draw_line(raster, x0, y0, x0, y0 + h, colour);
+    rafgl_raster_draw_line(raster, x0 + w, y0, x0 + w, y0 + h, colour);
+}
+
+/* resampling taps for one axis: dst sample i blends source i0[i] and i1[i] with weight frac[i] on i1, w[i] is that weight
+   in 0.16 fixed point. the taps live in scratch memory */
+typedef struct __resample_axis
+{
+    int *i0, *i1, *w;
+    float *frac;
+    __scratch_t scratch;
+} __resample_axis_t;
+
+static void __resample_axis_init(__resample_axis_t *axis, int dst_size, int src_size)
+{
+    int i;
+    float u;
+
+    axis->i0 = __scratch_begin(&axis->scratch, 3 * dst_size * sizeof(int) + dst_size * sizeof(float));
+    axis->i1 = axis->i0 + dst_size;
+    axis->w = axis->i1 + dst_size;
+    axis->frac = (float *)(axis->w + dst_size);
+
+    for(i = 0; i < dst_size; i++)
+    {
+        /* the float mapping of rafgl_bilinear_sample, rounding and all, so both pick the same texels and weights */
+        u = rafgl_clampf(((float)i / dst_size) * src_size - 0.5f, 0, src_size - 1.0f);
+
+        axis->i0[i] = (int)u;
+        axis->i1[i] = rafgl_min_m(axis->i0[i] + 1, src_size - 1);
+        axis->frac[i] = u - axis->i0[i];
+        /* 65536 would not fit the SSE2 kernel, the weight is off by 1 / 65536 at most either way */
+        axis->w[i] = rafgl_min_m((int)(axis->frac[i] * 65536.0f + 0.5f), 65535);
+    }
+}
+
+static void __resample_axis_cleanup(__resample_axis_t *axis)
+{
+    __scratch_end(&axis->scratch);
+}
+
+
+/* horizontal pass of one source row into 8.8 fixed point channels, 4 uint16 per destination pixel. it runs once per source
+   row, not per pixel, so it can afford the rafgl_lerpi of rafgl_bilinear_sample and give exactly its whole values */
+static void __upsample_row_horizontal_scalar(uint16_t *out, rafgl_raster_t *from, int sy, __resample_axis_t *cols, int w)
+{
+    int x, c;
+    float xs;
+    rafgl_pixel_rgb_t a, b;
+
+    for(x = 0; x < w; x++)
+    {
+        a = pixel_at_pm(from, cols->i0[x], sy);
+        b = pixel_at_pm(from, cols->i1[x], sy);
+        xs = cols->frac[x];
+        for(c = 0; c < 4; c++)
+        {
+            out[4 * x + c] = rafgl_lerpi(a.components[c], b.components[c], xs) << 8;
+        }
+    }
+}
+
+/* wy is the 0.16 weight of the bottom row. each row is scaled and truncated to 8.8 like the high-half multiplies of the
+   SSE2 kernel, so both give the same pixels. the two truncations lose less than 2 / 256 together and the + 1 makes that up,
+   a blend that lands on a whole value stays on it */
+static void __upsample_row_vertical_scalar(rafgl_pixel_rgb_t *out, const uint16_t *top, const uint16_t *bottom, int w, int wy)
+{
+    int i;
+    uint8_t *o = (uint8_t *)out;
+    uint32_t wt = 65536 - wy, wb = wy;
+
+    for(i = 0; i < 4 * w; i++)
+    {
+        o[i] = (((top[i] * wt) >> 16) + ((bottom[i] * wb) >> 16) + 1) >> 8;
+    }
+}
+
+#ifdef RAFGL_X86_SIMD
+
+/* one pixel per step, the four channels go through the single precision multiply, add and truncation of rafgl_lerpi side
+   by side, so the values match the scalar pass exactly */
+__attribute__((target("sse2")))
+static void __upsample_row_horizontal_sse2(uint16_t *out, rafgl_raster_t *from, int sy, __resample_axis_t *cols, int w)
+{
+    int x;
+    const rafgl_pixel_rgb_t *row = &pixel_at_pm(from, 0, sy);
+    __m128i zero = _mm_setzero_si128(), a, b, v;
+
+    for(x = 0; x < w; x++)
+    {
+        a = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)row[cols->i0[x]].rgba), zero), zero);
+        b = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)row[cols->i1[x]].rgba), zero), zero);
+        v = _mm_cvttps_epi32(_mm_add_ps(_mm_cvtepi32_ps(a), _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(b, a)), _mm_set1_ps(cols->frac[x]))));
+        _mm_storel_epi64((__m128i *)(out + 4 * x), _mm_slli_epi16(_mm_packs_epi32(v, v), 8));
+    }
+}
+
+__attribute__((target("sse2")))
+static void __upsample_row_vertical_sse2(rafgl_pixel_rgb_t *out, const uint16_t *top, const uint16_t *bottom, int w, int wy)
+{
+    int i = 0;
+    __m128i wt, wb, one, lo, hi;
+
+    if(wy == 0)
+    {
+        /* full weight on top would not fit the 0.16 multiplier below */
+        __upsample_row_vertical_scalar(out, top, bottom, w, 0);
+        return;
+    }
+
+    /* (((t * (65536 - wy)) >> 16) + ((b * wy) >> 16) + 1) >> 8, the high-half multiplies by 0.16 fixed point weights */
+    wt = _mm_set1_epi16((short)(65536 - wy));
+    wb = _mm_set1_epi16((short)wy);
+    one = _mm_set1_epi16(1);
+
+    for(; i + 4 <= w; i += 4)
+    {
+        lo = _mm_add_epi16(_mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(top + 4 * i)), wt),
+                           _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(bottom + 4 * i)), wb));
+        hi = _mm_add_epi16(_mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(top + 4 * i + 8)), wt),
+                           _mm_mulhi_epu16(_mm_loadu_si128((const __m128i *)(bottom + 4 * i + 8)), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, one), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, one), 8);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+    }
+
+    __upsample_row_vertical_scalar(out + i, top + 4 * i, bottom + 4 * i, w - i, wy);
+}
+
+#endif // RAFGL_X86_SIMD
+
+static void (*__upsample_row_horizontal_impl)(uint16_t *, rafgl_raster_t *, int, __resample_axis_t *, int) = __upsample_row_horizontal_scalar;
+static void (*__upsample_row_vertical_impl)(rafgl_pixel_rgb_t *, const uint16_t *, const uint16_t *, int, int) = __upsample_row_vertical_scalar;
+
+/* destination rows are split into a few bands per thread, each band keeps its own pair of filtered source rows */
+#define __UPSAMPLE_BANDS_PER_THREAD 4
+
+typedef struct __upsample_job
+{
+    rafgl_raster_t *to, *from;
+    __resample_axis_t cols, rows;
+    int band_count;
+    /* 2 rows of 4 * to->width uint16 per band, taken on the calling thread */
+    uint16_t *buffers;
+} __upsample_job_t;
+
+/* upsamples destination rows [y_begin, y_end) through the two rows in buffer. horizontally filtered source rows are kept and
+   reused while consecutive destination rows share them */
+static void __upsample_band(__upsample_job_t *job, int y_begin, int y_end, uint16_t *buffer)
+{
+    rafgl_raster_t *to = job->to, *from = job->from;
+    __resample_axis_t *cols = &job->cols, *rows = &job->rows;
+    int y, w = to->width;
+    int top_row = -1, bottom_row = -1;
+    uint16_t *top = buffer, *bottom = buffer + 4 * w, *swap;
+    void (*horizontal)(uint16_t *, rafgl_raster_t *, int, __resample_axis_t *, int);
+    void (*vertical)(rafgl_pixel_rgb_t *, const uint16_t *, const uint16_t *, int, int);
+
+    __cpu_dispatch();
+    horizontal = __upsample_row_horizontal_impl;
+    vertical = __upsample_row_vertical_impl;
+
+    for(y = y_begin; y < y_end; y++)
+    {
+        if(rows->i0[y] == bottom_row && top_row != bottom_row)
+        {
+            /* moved down one source row, the old bottom becomes the new top */
+            swap = top;
+            top = bottom;
+            bottom = swap;
+            top_row = bottom_row;
+            bottom_row = -1;
+        }
+
+        if(rows->i0[y] != top_row)
+        {
+            top_row = rows->i0[y];
+            horizontal(top, from, top_row, cols, w);
+        }
+
+        if(rows->i1[y] != bottom_row)
+        {
+            bottom_row = rows->i1[y];
+            if(bottom_row == top_row)
+                memcpy(bottom, top, 4 * w * sizeof(uint16_t));
+            else
+                horizontal(bottom, from, bottom_row, cols, w);
+        }
+
+        vertical(&pixel_at_pm(to, 0, y), top, bottom, w, rows->w[y]);
+    }
+}
+
+static void __upsample_bands(int band_begin, int band_end, void *ctx)
+{
+    __upsample_job_t *job = ctx;
+    int band, h = job->to->height;
+
+    for(band = band_begin; band < band_end; band++)
+    {
+        __upsample_band(job, (int)((int64_t)band * h / job->band_count), (int)((int64_t)(band + 1) * h / job->band_count),
+                        job->buffers + (size_t)band * 2 * 4 * job->to->width);
+    }
+}
+
+void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from)
+{
+    __upsample_job_t job;
+    __scratch_t buffers_scratch;
+    int64_t pixels = (int64_t)to->width * to->height;
+    rafgl_raster_t to_copy, from_copy, *to_linear, *from_linear;
+    __scratch_t to_scratch, from_scratch;
+
+    if(to->layout != RAFGL_LAYOUT_LINEAR || from->layout != RAFGL_LAYOUT_LINEAR)
+    {
+        from_linear = __linear_begin(from, &from_copy, &from_scratch, 1);
+        to_linear = (from_linear != NULL) ? __linear_begin(to, &to_copy, &to_scratch, 0) : NULL;
+        if(to_linear != NULL)
+            rafgl_raster_bilinear_upsample(to_linear, from_linear);
+        __linear_end(to, to_linear, &to_scratch, 1);
+        __linear_end(from, from_linear, &from_scratch, 0);
+        return;
+    }
+    if(pixels <= 0) return;
+
+    job.to = to;
+    job.from = from;
+    __resample_axis_init(&job.cols, to->width, from->width);
+    __resample_axis_init(&job.rows, to->height, from->height);
+
+    /* about __PARALLEL_JOB_PIXELS per band, but never so many that the row buffers outgrow the threads that could use them */
+    job.band_count = (int)rafgl_min_m((pixels + __PARALLEL_JOB_PIXELS - 1) / __PARALLEL_JOB_PIXELS, (int64_t)__UPSAMPLE_BANDS_PER_THREAD * rafgl_max_m(rafgl_jobs_thread_count(), 1));
+    job.band_count = rafgl_min_m(job.band_count, to->height);
+    /* taken here, the workers must not touch the arena */
+    job.buffers = __scratch_begin(&buffers_scratch, (size_t)job.band_count * 2 * 4 * to->width * sizeof(uint16_t));
+
+    rafgl_parallel_for(job.band_count, 1, __upsample_bands, &job);
+    rafgl_raster_mark_dirty(to, 0, 0, to->width, to->height);
+
+    __scratch_end(&buffers_scratch);
+    __resample_axis_cleanup(&job.rows);
+    __resample_axis_cleanup(&job.cols);
+}
+
+/* planar rasters */
+
+/* sets up the size and stride, returns the bytes one plane needs */
+static size_t __planar_layout(rafgl_planar_t *planar, int width, int height)
+{
+    /* every plane row starts on a cache line, like raster rows */
+    planar->stride = (width + RAFGL_ROW_ALIGN - 1) / RAFGL_ROW_ALIGN * RAFGL_ROW_ALIGN;
+    planar->width = width;
+    planar->height = height;
+    return (size_t)planar->stride * height;
+}
+
+static int __planar_set_base(rafgl_planar_t *planar, uint8_t *base, size_t plane)
+{
+    int c;
+
+    for(c = 0; c < 4; c++)
+        planar->planes[c] = (base != NULL) ? base + c * plane : NULL;
+    return (base != NULL) ? 0 : -1;
+}
+
+static int __planar_alloc(rafgl_planar_t *planar, int width, int height, int transient)
+{
+    size_t plane = __planar_layout(planar, width, height);
+
+    planar->transient = transient;
+    return __planar_set_base(planar, transient ? rafgl_frame_alloc(4 * plane) : __aligned_calloc(4 * plane), plane);
+}
+
+int rafgl_planar_init(rafgl_planar_t *planar, int width, int height)
+{
+    return __planar_alloc(planar, width, height, 0);
+}
+
+int rafgl_planar_init_transient(rafgl_planar_t *planar, int width, int height)
+{
+    return __planar_alloc(planar, width, height, 1);
+}
+
+int rafgl_planar_cleanup(rafgl_planar_t *planar)
+{
+    int c;
+
+    if(!planar->transient)
+        __aligned_free(planar->planes[0]);
+    for(c = 0; c < 4; c++)
+        planar->planes[c] = NULL;
+    planar->width = planar->height = 0;
+    return 0;
+}
+
+/* row kernels. planes[c] points at the row of plane c, count pixels */
+typedef struct __planar_row_kernels
+{
+    void (*split)(uint8_t **planes, const rafgl_pixel_rgb_t *src, int count);
+    void (*join)(rafgl_pixel_rgb_t *dst, uint8_t **planes, int count);
+    void (*brightness)(uint8_t *dst, const uint8_t *r, const uint8_t *g, const uint8_t *b, int count);
+    void (*lerp)(uint8_t *dst, const uint8_t *from, const uint8_t *to, int count, int t);
+} __planar_row_kernels_t;
+
+static void __planar_split_scalar(uint8_t **planes, const rafgl_pixel_rgb_t *src, int count)
+{
+    int i, c;
+
+    for(i = 0; i < count; i++)
+        for(c = 0; c < 4; c++) planes[c][i] = src[i].components[c];
+}
+
+static void __planar_join_scalar(rafgl_pixel_rgb_t *dst, uint8_t **planes, int count)
+{
+    int i, c;
+
+    for(i = 0; i < count; i++)
+        for(c = 0; c < 4; c++) dst[i].components[c] = planes[c][i];
+}
+
+/* 0.3, 0.59 and 0.11 in 8 bit fixed point, they add up to 256 so white stays 255 */
+#define __BRIGHTNESS_R 77
+#define __BRIGHTNESS_G 151
+#define __BRIGHTNESS_B 28
+
+static void __planar_brightness_scalar(uint8_t *dst, const uint8_t *r, const uint8_t *g, const uint8_t *b, int count)
+{
+    int i;
+
+    for(i = 0; i < count; i++)
+        dst[i] = (__BRIGHTNESS_R * r[i] + __BRIGHTNESS_G * g[i] + __BRIGHTNESS_B * b[i]) >> 8;
+}
+
+/* t is the weight of to in 8 bit fixed point, 0 to 256 */
+static void __planar_lerp_scalar(uint8_t *dst, const uint8_t *from, const uint8_t *to, int count, int t)
+{
+    int i;
+
+    for(i = 0; i < count; i++)
+        dst[i] = (from[i] * (256 - t) + to[i] * t) >> 8;
+}
+
+#ifdef RAFGL_X86_SIMD
+
+/* 16 pixels at a time: each channel is masked out of the 32 bit lanes and packed down to bytes */
+__attribute__((target("sse2")))
+static void __planar_split_sse2(uint8_t **planes, const rafgl_pixel_rgb_t *src, int count)
+{
+    int i = 0, c;
+    __m128i a0, a1, a2, a3, mask = _mm_set1_epi32(0xff);
+    __m128i lo, hi;
+    uint8_t *rest[4];
+
+    for(; i + 16 <= count; i += 16)
+    {
+        a0 = _mm_loadu_si128((const __m128i *)(src + i));
+        a1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        a2 = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        a3 = _mm_loadu_si128((const __m128i *)(src + i + 12));
+
+        for(c = 0; c < 4; c++)
+        {
+            lo = _mm_packs_epi32(_mm_and_si128(a0, mask), _mm_and_si128(a1, mask));
+            hi = _mm_packs_epi32(_mm_and_si128(a2, mask), _mm_and_si128(a3, mask));
+            _mm_storeu_si128((__m128i *)(planes[c] + i), _mm_packus_epi16(lo, hi));
+
+            a0 = _mm_srli_epi32(a0, 8);
+            a1 = _mm_srli_epi32(a1, 8);
+            a2 = _mm_srli_epi32(a2, 8);
+            a3 = _mm_srli_epi32(a3, 8);
+        }
+    }
+
+    for(c = 0; c < 4; c++) rest[c] = planes[c] + i;
+    __planar_split_scalar(rest, src + i, count - i);
+}
+
+/* byte-interleaves r with g and b with a, then the two 16 bit halves, which gives back r g b a per pixel */
+__attribute__((target("sse2")))
+static void __planar_join_sse2(rafgl_pixel_rgb_t *dst, uint8_t **planes, int count)
+{
+    int i = 0, c;
+    __m128i r, g, b, a, rg, ba;
+    uint8_t *rest[4];
+
+    for(; i + 16 <= count; i += 16)
+    {
+        r = _mm_loadu_si128((const __m128i *)(planes[0] + i));
+        g = _mm_loadu_si128((const __m128i *)(planes[1] + i));
+        b = _mm_loadu_si128((const __m128i *)(planes[2] + i));
+        a = _mm_loadu_si128((const __m128i *)(planes[3] + i));
+
+        rg = _mm_unpacklo_epi8(r, g);
+        ba = _mm_unpacklo_epi8(b, a);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(rg, ba));
+
+        rg = _mm_unpackhi_epi8(r, g);
+        ba = _mm_unpackhi_epi8(b, a);
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpacklo_epi16(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + i + 12), _mm_unpackhi_epi16(rg, ba));
+    }
+
+    for(c = 0; c < 4; c++) rest[c] = planes[c] + i;
+    __planar_join_scalar(dst + i, rest, count - i);
+}
+
+/* the weighted sum of three bytes with weights adding up to 256 never leaves an unsigned 16 bit lane */
+__attribute__((target("sse2")))
+static void __planar_brightness_sse2(uint8_t *dst, const uint8_t *r, const uint8_t *g, const uint8_t *b, int count)
+{
+    int i = 0;
+    __m128i zero = _mm_setzero_si128();
+    __m128i wr = _mm_set1_epi16(__BRIGHTNESS_R), wg = _mm_set1_epi16(__BRIGHTNESS_G), wb = _mm_set1_epi16(__BRIGHTNESS_B);
+    __m128i vr, vg, vb, lo, hi;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        vr = _mm_loadu_si128((const __m128i *)(r + i));
+        vg = _mm_loadu_si128((const __m128i *)(g + i));
+        vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+        lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vr, zero), wr), _mm_mullo_epi16(_mm_unpacklo_epi8(vg, zero), wg)),
+                           _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vr, zero), wr), _mm_mullo_epi16(_mm_unpackhi_epi8(vg, zero), wg)),
+                           _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+
+    __planar_brightness_scalar(dst + i, r + i, g + i, b + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static void __planar_lerp_sse2(uint8_t *dst, const uint8_t *from, const uint8_t *to, int count, int t)
+{
+    int i = 0;
+    __m128i zero = _mm_setzero_si128();
+    __m128i wf = _mm_set1_epi16((short)(256 - t)), wt = _mm_set1_epi16((short)t);
+    __m128i f, g, lo, hi;
+
+    for(; i + 16 <= count; i += 16)
+    {
+        f = _mm_loadu_si128((const __m128i *)(from + i));
+        g = _mm_loadu_si128((const __m128i *)(to + i));
+
+        lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(f, zero), wf), _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), wt));
+        hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(f, zero), wf), _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), wt));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+
+    __planar_lerp_scalar(dst + i, from + i, to + i, count - i, t);
+}
+
+#endif // RAFGL_X86_SIMD
+
+static __planar_row_kernels_t __planar_kernels = {__planar_split_scalar, __planar_join_scalar, __planar_brightness_scalar, __planar_lerp_scalar};
+
+static __planar_row_kernels_t *__planar_row_kernels(void)
+{
+    __cpu_dispatch();
+    return &__planar_kernels;
+}
+
+typedef struct __planar_job
+{
+    rafgl_planar_t *result, *from, *to, *tmp;
+    rafgl_raster_t *raster;
+    __planar_row_kernels_t *kernels;
+    const uint8_t (*curves)[256];
+    int t, radius;
+    int *sums;
+} __planar_job_t;
+
+static void __planar_rows(rafgl_planar_t *planar, int y, uint8_t **rows)
+{
+    int c;
+
+    for(c = 0; c < 4; c++) rows[c] = &plane_at_pm(planar, c, 0, y);
+}
+
+static void __planar_split_rows(int y_begin, int y_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    uint8_t *rows[4];
+
+    for(; y_begin < y_end; y_begin++)
+    {
+        __planar_rows(job->result, y_begin, rows);
+        job->kernels->split(rows, &pixel_at_pm(job->raster, 0, y_begin), job->raster->width);
+    }
+}
+
+static void __planar_join_rows(int y_begin, int y_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    uint8_t *rows[4];
+
+    for(; y_begin < y_end; y_begin++)
+    {
+        __planar_rows(job->from, y_begin, rows);
+        job->kernels->join(&pixel_at_pm(job->raster, 0, y_begin), rows, job->raster->width);
+    }
+}
+
+/* rows of the planar kernels run in chunks of about __PARALLEL_JOB_PIXELS */
+static void __planar_run(rafgl_planar_t *planar, void (*fn)(int, int, void *), __planar_job_t *job)
+{
+    job->kernels = __planar_row_kernels();
+    rafgl_parallel_for(planar->height, __PARALLEL_JOB_PIXELS / rafgl_max_m(planar->width, 1) + 1, fn, job);
+}
+
+int rafgl_planar_from_raster(rafgl_planar_t *planar, rafgl_raster_t *raster)
+{
+    __planar_job_t job;
+
+    if(raster->layout != RAFGL_LAYOUT_LINEAR) return -1;
+
+    if(planar->planes[0] == NULL)
+        rafgl_planar_init(planar, raster->width, raster->height);
+    else if(planar->width != raster->width || planar->height != raster->height)
+        return -1;
+
+    job.result = planar;
+    job.raster = raster;
+    __planar_run(planar, __planar_split_rows, &job);
+    return 0;
+}
+
+int rafgl_planar_to_raster(rafgl_raster_t *raster, rafgl_planar_t *planar)
+{
+    __planar_job_t job;
+
+    if(raster->data == NULL)
+        rafgl_raster_init(raster, planar->width, planar->height);
+    else if(raster->layout != RAFGL_LAYOUT_LINEAR || raster->width != planar->width || raster->height != planar->height)
+        return -1;
+
+    job.from = planar;
+    job.raster = raster;
+    __planar_run(planar, __planar_join_rows, &job);
+
+    rafgl_raster_mark_dirty(raster, 0, 0, raster->width, raster->height);
+    return 0;
+}
+
+static void __planar_brightness_rows(int y_begin, int y_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    uint8_t *in[4], *out[4];
+    int c, w = job->from->width;
+
+    for(; y_begin < y_end; y_begin++)
+    {
+        __planar_rows(job->from, y_begin, in);
+        __planar_rows(job->result, y_begin, out);
+
+        job->kernels->brightness(out[0], in[0], in[1], in[2], w);
+        for(c = 1; c < 3; c++) memcpy(out[c], out[0], w);
+        if(out[3] != in[3]) memcpy(out[3], in[3], w);
+    }
+}
+
+void rafgl_planar_brightness(rafgl_planar_t *result, rafgl_planar_t *from)
+{
+    __planar_job_t job;
+
+    job.result = result;
+    job.from = from;
+    __planar_run(from, __planar_brightness_rows, &job);
+}
+
+static void __planar_lerp_rows(int y_begin, int y_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    uint8_t *a[4], *b[4], *out[4];
+    int c;
+
+    for(; y_begin < y_end; y_begin++)
+    {
+        __planar_rows(job->from, y_begin, a);
+        __planar_rows(job->to, y_begin, b);
+        __planar_rows(job->result, y_begin, out);
+
+        for(c = 0; c < 4; c++) job->kernels->lerp(out[c], a[c], b[c], job->from->width, job->t);
+    }
+}
+
+void rafgl_planar_lerp(rafgl_planar_t *result, rafgl_planar_t *from, rafgl_planar_t *to, float scale)
+{
+    __planar_job_t job;
+
+    job.result = result;
+    job.from = from;
+    job.to = to;
+    job.t = rafgl_clampi((int)(scale * 256.0f + 0.5f), 0, 256);
+    __planar_run(from, __planar_lerp_rows, &job);
+}
+
+/* a lookup per byte, every plane has its own table so there is nothing to shuffle */
+static void __planar_grade_rows(int y_begin, int y_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    uint8_t *in[4], *out[4];
+    const uint8_t *curve;
+    int c, x;
+
+    for(; y_begin < y_end; y_begin++)
+    {
+        __planar_rows(job->from, y_begin, in);
+        __planar_rows(job->result, y_begin, out);
+
+        for(c = 0; c < 4; c++)
+        {
+            curve = job->curves[c];
+            for(x = 0; x < job->from->width; x++) out[c][x] = curve[in[c][x]];
+        }
+    }
+}
+
+void rafgl_planar_grade(rafgl_planar_t *result, rafgl_planar_t *from, const uint8_t curves[4][256])
+{
+    __planar_job_t job;
+
+    job.result = result;
+    job.from = from;
+    job.curves = curves;
+    __planar_run(from, __planar_grade_rows, &job);
+}
+
+/* horizontal pass of the box blur over rows [y_begin, y_end) of every plane, same sliding window sums as __box_blur_rows */
+static void __planar_blur_rows(int y_begin, int y_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    int x, y, c, sum, w = job->from->width, r = job->radius, n = 2 * r + 1;
+    const uint8_t *row;
+    uint8_t *out;
+
+    for(y = y_begin; y < y_end; y++)
+    {
+        for(c = 0; c < 4; c++)
+        {
+            row = &plane_at_pm(job->from, c, 0, y);
+            out = &plane_at_pm(job->tmp, c, 0, y);
+
+            sum = 0;
+            for(x = -r; x <= r; x++) sum += row[rafgl_clampi(x, 0, w - 1)];
+
+            for(x = 0; x < w; x++)
+            {
+                out[x] = sum / n;
+                sum += row[rafgl_min_m(x + r + 1, w - 1)] - row[rafgl_max_m(x - r, 0)];
+            }
+        }
+    }
+}
+
+/* vertical pass over column blocks [block_begin, block_end) of all planes, block b covers plane b / blocks_per_plane */
+static void __planar_blur_columns(int block_begin, int block_end, void *ctx)
+{
+    __planar_job_t *job = ctx;
+    int blocks_per_plane = (job->tmp->width + __BOX_BLUR_BLOCK - 1) / __BOX_BLUR_BLOCK;
+    int h = job->tmp->height, r = job->radius, n = 2 * r + 1;
+    int c, x0, count, i, y;
+    int *sums;
+    const uint8_t *add, *sub;
+    uint8_t *out;
+
+    for(; block_begin < block_end; block_begin++)
+    {
+        c = block_begin / blocks_per_plane;
+        x0 = (block_begin % blocks_per_plane) * __BOX_BLUR_BLOCK;
+        count = rafgl_min_m(__BOX_BLUR_BLOCK, job->tmp->width - x0);
+        sums = job->sums + c * job->tmp->width + x0;
+
+        memset(sums, 0, count * sizeof(int));
+        for(y = -r; y <= r; y++)
+        {
+            add = &plane_at_pm(job->tmp, c, x0, rafgl_clampi(y, 0, h - 1));
+            for(i = 0; i < count; i++) sums[i] += add[i];
+        }
+
+        for(y = 0; y < h; y++)
+        {
+            out = &plane_at_pm(job->result, c, x0, y);
+            for(i = 0; i < count; i++) out[i] = sums[i] / n;
+
+            add = &plane_at_pm(job->tmp, c, x0, rafgl_min_m(y + r + 1, h - 1));
+            sub = &plane_at_pm(job->tmp, c, x0, rafgl_max_m(y - r, 0));
+            for(i = 0; i < count; i++) sums[i] += add[i] - sub[i];
+        }
+    }
+}
+
+void rafgl_planar_box_blur(rafgl_planar_t *result, rafgl_planar_t *tmp, rafgl_planar_t *from, int radius)
+{
+    __planar_job_t job;
+    rafgl_planar_t horizontal;
+    __scratch_t tmp_scratch, sums_scratch;
+    size_t plane;
+
+    if(tmp == NULL)
+    {
+        plane = __planar_layout(&horizontal, from->width, from->height);
+        horizontal.transient = 0;
+        __planar_set_base(&horizontal, __scratch_begin(&tmp_scratch, 4 * plane), plane);
+        tmp = &horizontal;
+    }
+
+    job.result = result;
+    job.tmp = tmp;
+    job.from = from;
+    job.radius = rafgl_max_m(radius, 0);
+    /* taken here, the workers must not touch the arena */
+    job.sums = __scratch_begin(&sums_scratch, 4 * tmp->width * sizeof(int));
+
+    rafgl_parallel_for(from->height, __PARALLEL_JOB_PIXELS / (4 * rafgl_max_m(from->width, 1)) + 1, __planar_blur_rows, &job);
+    rafgl_parallel_for(4 * ((tmp->width + __BOX_BLUR_BLOCK - 1) / __BOX_BLUR_BLOCK), 1, __planar_blur_columns, &job);
+
+    __scratch_end(&sums_scratch);
+    if(tmp == &horizontal)
+        __scratch_end(&tmp_scratch);
+}
+
+static void __raster_fill_rect(rafgl_raster_t *raster, const rafgl_rect_t *r, uint32_t colour)
+{
+    int x, y;
+
+    for(y = r->y; y < r->y + r->height; y++)
+        for(x = r->x; x < r->x + r->width; x++)
+            pixel_at_pm(raster, x, y).rgba = colour;
+}
+
+int rafgl_compositor_init(rafgl_compositor_t *compositor, int width, int height)
+{
+    compositor->width = width;
+    compositor->height = height;
+    compositor->layer_count = 0;
+    compositor->damage.count = 0;
+    return 0;
+}
+
+int rafgl_compositor_add_layer(rafgl_compositor_t *compositor, int flags, rafgl_layer_render_fn render, void *ctx)
+{
+    rafgl_layer_t *layer;
+    rafgl_rect_t whole;
+
+    if(compositor->layer_count == RAFGL_MAX_LAYERS) return -1;
+
+    layer = &compositor->layers[compositor->layer_count];
+    layer->flags = flags;
+    layer->render = render;
+    layer->ctx = ctx;
+    layer->invalid.count = 0;
+
+    rafgl_raster_init(&layer->raster, compositor->width, compositor->height);
+    rafgl_raster_track_dirty(&layer->raster);
+
+    whole.x = whole.y = 0;
+    whole.width = compositor->width;
+    whole.height = compositor->height;
+
+    if(flags & RAFGL_LAYER_VOLATILE)
+    {
+        if(!(flags & RAFGL_LAYER_OPAQUE))
+            __raster_fill_rect(&layer->raster, &whole, RAFGL_COLOUR_KEY.rgba);
+    }
+    else
+    {
+        __dirty_list_add(&layer->invalid, &whole, compositor->width, compositor->height);
+    }
+
+    return compositor->layer_count++;
+}
+
+rafgl_raster_t* rafgl_compositor_layer(rafgl_compositor_t *compositor, int index)
+{
+    return &compositor->layers[index].raster;
+}
+
+void rafgl_compositor_invalidate(rafgl_compositor_t *compositor, int index, int x, int y, int width, int height)
+{
+    rafgl_rect_t r;
+
+    r.x = x;
+    r.y = y;
+    r.width = width;
+    r.height = height;
+    __dirty_list_add(&compositor->layers[index].invalid, &r, compositor->width, compositor->height);
+}
+
+void rafgl_compositor_begin_frame(rafgl_compositor_t *compositor)
+{
+    rafgl_layer_t *layer;
+    int i, j;
+
+    /* volatile layers keep what they drew last frame in invalid, wipe it back to transparent */
+    for(i = 0; i < compositor->layer_count; i++)
+    {
+        layer = &compositor->layers[i];
+        if(!(layer->flags & RAFGL_LAYER_VOLATILE)) continue;
+
+        for(j = 0; j < layer->invalid.count; j++)
+        {
+            if(!(layer->flags & RAFGL_LAYER_OPAQUE))
+                __raster_fill_rect(&layer->raster, &layer->invalid.rects[j], RAFGL_COLOUR_KEY.rgba);
+            __dirty_list_add(&compositor->damage, &layer->invalid.rects[j], compositor->width, compositor->height);
+        }
+        layer->invalid.count = 0;
+    }
+}
+
+int rafgl_compositor_compose(rafgl_compositor_t *compositor, rafgl_raster_t *target)
+{
+    rafgl_layer_t *layer;
+    rafgl_rect_t *r;
+    int i, j, y;
+
+    for(i = 0; i < compositor->layer_count; i++)
+    {
+        layer = &compositor->layers[i];
+
+        /* cached layers re-render only their invalidated areas, clipped so neighbours stay untouched */
+        if(!(layer->flags & RAFGL_LAYER_VOLATILE) && layer->render != NULL)
+        {
+            __dirty_list_merge(&layer->invalid);
+            for(j = 0; j < layer->invalid.count; j++)
+            {
+                r = &layer->invalid.rects[j];
+                if(!(layer->flags & RAFGL_LAYER_OPAQUE))
+                    __raster_fill_rect(&layer->raster, r, RAFGL_COLOUR_KEY.rgba);
+
+                rafgl_raster_set_clip(&layer->raster, r->x, r->y, r->width, r->height);
+                layer->render(&layer->raster, r, layer->ctx);
+                rafgl_raster_set_clip(&layer->raster, 0, 0, layer->raster.width, layer->raster.height);
+
+                __dirty_list_add(&compositor->damage, r, compositor->width, compositor->height);
+            }
+            layer->invalid.count = 0;
+        }
+
+        for(j = 0; j < layer->raster.dirty->count; j++)
+            __dirty_list_add(&compositor->damage, &layer->raster.dirty->rects[j], compositor->width, compositor->height);
+
+        if(layer->flags & RAFGL_LAYER_VOLATILE)
+            layer->invalid = *layer->raster.dirty;
+
+        rafgl_raster_clear_dirty(&layer->raster);
+    }
+
+    /* back to front over the damaged areas only */
+    __dirty_list_merge(&compositor->damage);
+    for(j = 0; j < compositor->damage.count; j++)
+    {
+        r = &compositor->damage.rects[j];
+
+        for(i = 0; i < compositor->layer_count; i++)
+        {
+            layer = &compositor->layers[i];
+            if(layer->flags & RAFGL_LAYER_OPAQUE)
+            {
+                for(y = r->y; y < r->y + r->height; y++)
+                    memcpy(&pixel_at_pm(target, r->x, y), &pixel_at_m(layer->raster, r->x, y), r->width * sizeof(rafgl_pixel_rgb_t));
+            }
+            else
+            {
+                __draw_keyed(target, &layer->raster, r->x, r->y, r->width, r->height, -1, r->x, r->y, 0, 0, 0);
+            }
+        }
+
+        rafgl_raster_mark_dirty(target, r->x, r->y, r->width, r->height);
+    }
+
+    i = compositor->damage.count;
+    compositor->damage.count = 0;
+    return i;
+}
+
+void rafgl_compositor_cleanup(rafgl_compositor_t *compositor)
+{
+    int i;
+
+    for(i = 0; i < compositor->layer_count; i++)
+        rafgl_raster_cleanup(&compositor->layers[i].raster);
+    compositor->layer_count = 0;
+}
+
+int rafgl_atlas_init(rafgl_atlas_t *atlas, int width, int height, int padding)
+{
+    int i;
+
+    rafgl_raster_init(&atlas->raster, width, height);
+    for(i = 0; i < atlas->raster.stride * height; i++)
+        atlas->raster.data[i].rgba = RAFGL_COLOUR_KEY.rgba;
+
+    atlas->padding = rafgl_max_m(padding, 0);
+
+    /* the skyline starts as one flat segment along the top edge */
+    atlas->skyline_capacity = 16;
+    atlas->skyline = malloc(atlas->skyline_capacity * sizeof(rafgl_rect_t));
+    atlas->skyline[0].x = 0;
+    atlas->skyline[0].y = 0;
+    atlas->skyline[0].width = width;
+    atlas->skyline_count = 1;
+
+    atlas->region_capacity = 32;
+    atlas->regions = malloc(atlas->region_capacity * sizeof(rafgl_atlas_region_t));
+    atlas->region_count = 0;
+
+    return 0;
+}
+
+/* lowest y a width wide block can rest at when its left edge sits on segment i, -1 if it runs off the right edge */
+static int __skyline_fit(rafgl_atlas_t *atlas, int i, int width)
+{
+    int x = atlas->skyline[i].x, y = 0, left = width;
+
+    if(x + width > atlas->raster.width) return -1;
+
+    for(; left > 0; i++)
+    {
+        y = rafgl_max_m(y, atlas->skyline[i].y);
+        left -= atlas->skyline[i].width;
+    }
+
+    return y;
+}
+
+/* raises the skyline under a block placed at (x, y) */
+static void __skyline_place(rafgl_atlas_t *atlas, int i, int x, int y, int width, int height)
+{
+    rafgl_rect_t *s;
+    int j, shrink;
+
+    if(atlas->skyline_count == atlas->skyline_capacity)
+    {
+        atlas->skyline_capacity *= 2;
+        atlas->skyline = realloc(atlas->skyline, atlas->skyline_capacity * sizeof(rafgl_rect_t));
+    }
+
+    s = atlas->skyline;
+    memmove(s + i + 1, s + i, (atlas->skyline_count - i) * sizeof(rafgl_rect_t));
+    s[i].x = x;
+    s[i].y = y + height;
+    s[i].width = width;
+    atlas->skyline_count++;
+
+    /* segments now under the block get cut or dropped */
+    for(j = i + 1; j < atlas->skyline_count; )
+    {
+        if(s[j].x >= s[i].x + s[i].width) break;
+
+        shrink = s[i].x + s[i].width - s[j].x;
+        s[j].x += shrink;
+        s[j].width -= shrink;
+
+        if(s[j].width > 0) break;
+
+        memmove(s + j, s + j + 1, (atlas->skyline_count - j - 1) * sizeof(rafgl_rect_t));
+        atlas->skyline_count--;
+    }
+
+    /* neighbours at the same height become one segment */
+    for(j = 0; j + 1 < atlas->skyline_count; )
+    {
+        if(s[j].y == s[j + 1].y)
+        {
+            s[j].width += s[j + 1].width;
+            memmove(s + j + 1, s + j + 2, (atlas->skyline_count - j - 2) * sizeof(rafgl_rect_t));
+            atlas->skyline_count--;
+        }
+        else
+        {
+            j++;
+        }
+    }
+}
+
+int rafgl_atlas_add_region(rafgl_atlas_t *atlas, rafgl_raster_t *image, int src_x, int src_y, int width, int height)
+{
+    rafgl_atlas_region_t *region;
+    int i, y, fit, best = -1, best_y = INT_MAX, best_w = INT_MAX;
+    int source_width = width, source_height = height, offset_x = 0, offset_y = 0;
+    int w, h;
+
+    /* keyed margins are not worth atlas space */
+    __trim_block(image, &src_x, &src_y, &width, &height, &offset_x, &offset_y, 0);
+    w = width + atlas->padding;
+    h = height + atlas->padding;
+
+    /* bottom-left rule: the lowest resting place, the narrowest segment on ties */
+    for(i = 0; width > 0 && height > 0 && i < atlas->skyline_count; i++)
+    {
+        fit = __skyline_fit(atlas, i, w);
+        if(fit < 0 || fit + height > atlas->raster.height) continue;
+
+        if(fit < best_y || (fit == best_y && atlas->skyline[i].width < best_w))
+        {
+            best = i;
+            best_y = fit;
+            best_w = atlas->skyline[i].width;
+        }
+    }
+
+    /* a fully keyed image takes no space and draws nothing */
+    if(width == 0 || height == 0)
+        width = height = best_y = 0;
+    else if(best < 0)
+        return -1;
+
+    if(atlas->region_count == atlas->region_capacity)
+    {
+        atlas->region_capacity *= 2;
+        atlas->regions = realloc(atlas->regions, atlas->region_capacity * sizeof(rafgl_atlas_region_t));
+    }
+
+    region = &atlas->regions[atlas->region_count];
+    region->x = (best >= 0) ? atlas->skyline[best].x : 0;
+    region->y = best_y;
+    region->width = width;
+    region->height = height;
+    region->offset_x = offset_x;
+    region->offset_y = offset_y;
+    region->source_width = source_width;
+    region->source_height = source_height;
+    region->u0 = (float)region->x / atlas->raster.width;
+    region->v0 = (float)region->y / atlas->raster.height;
+    region->u1 = (float)(region->x + width) / atlas->raster.width;
+    region->v1 = (float)(region->y + height) / atlas->raster.height;
+
+    if(best >= 0)
+        __skyline_place(atlas, best, region->x, best_y, w, rafgl_min_m(h, atlas->raster.height - best_y));
+
+    for(y = 0; y < height; y++)
+        memcpy(&pixel_at_m(atlas->raster, region->x, region->y + y), &pixel_at_pm(image, src_x, src_y + y), width * sizeof(rafgl_pixel_rgb_t));
+
+    /* cached runs no longer cover everything */
+    rafgl_raster_spans_cleanup(&atlas->raster);
+
+    return atlas->region_count++;
+}
+
+int rafgl_atlas_add(rafgl_atlas_t *atlas, rafgl_raster_t *image)
+{
+    return rafgl_atlas_add_region(atlas, image, 0, 0, image->width, image->height);
+}
+
+int rafgl_atlas_add_spritesheet(rafgl_atlas_t *atlas, rafgl_spritesheet_t *spritesheet)
+{
+    int x, y, i, first = atlas->region_count, skyline_count = atlas->skyline_count;
+    rafgl_rect_t *skyline = malloc(rafgl_max_m(skyline_count, 1) * sizeof(rafgl_rect_t)), area;
+
+    /* the skyline as it was, to hand the space of a partly packed sheet back */
+    memcpy(skyline, atlas->skyline, skyline_count * sizeof(rafgl_rect_t));
+
+    for(y = 0; y < spritesheet->sheet_height; y++)
+    {
+        for(x = 0; x < spritesheet->sheet_width; x++)
+        {
+            if(rafgl_atlas_add_region(atlas, &spritesheet->sheet, x * spritesheet->frame_width, y * spritesheet->frame_height, spritesheet->frame_width, spritesheet->frame_height) < 0)
+            {
+                /* all frames or none, the frames already copied go back to empty space */
+                for(i = first; i < atlas->region_count; i++)
+                {
+                    area.x = atlas->regions[i].x;
+                    area.y = atlas->regions[i].y;
+                    area.width = atlas->regions[i].width;
+                    area.height = atlas->regions[i].height;
+                    __raster_fill_rect(&atlas->raster, &area, RAFGL_COLOUR_KEY.rgba);
+                    rafgl_raster_mark_dirty(&atlas->raster, area.x, area.y, area.width, area.height);
+                }
+
+                memcpy(atlas->skyline, skyline, skyline_count * sizeof(rafgl_rect_t));
+                atlas->skyline_count = skyline_count;
+                atlas->region_count = first;
+                free(skyline);
+                return -1;
+            }
+        }
+    }
+
+    free(skyline);
+    return first;
+}
+
+void rafgl_atlas_finish(rafgl_atlas_t *atlas)
+{
+    rafgl_raster_build_spans(&atlas->raster);
+}
+
+void rafgl_raster_draw_region(rafgl_raster_t *raster, rafgl_atlas_t *atlas, int region, int x, int y, rafgl_pixel_rgb_t boja, int flags)
+{
+    rafgl_atlas_region_t *r = &atlas->regions[region];
+    int cell = (atlas->raster.spans != NULL) ? 0 : -1;
+
+    /* put the trimmed box back where it was in the original, mirrored along with the flips */
+    x += (flags & RAFGL_FLIP_HORIZONTAL) ? r->source_width - r->offset_x - r->width : r->offset_x;
+    y += (flags & RAFGL_FLIP_VERTICAL) ? r->source_height - r->offset_y - r->height : r->offset_y;
+
+    __draw_keyed(raster, &atlas->raster, r->x, r->y, r->width, r->height, cell, x, y, 1, boja.rgba, flags);
+}
+
+void rafgl_atlas_cleanup(rafgl_atlas_t *atlas)
+{
+    rafgl_raster_cleanup(&atlas->raster);
+    free(atlas->skyline);
+    free(atlas->regions);
+    atlas->skyline = NULL;
+    atlas->regions = NULL;
+    atlas->skyline_count = atlas->region_count = 0;
+}
+
+/* pads the file to RAFGL_PACK_ALIGN, writes the block and returns where it starts */
+static uint64_t __pack_write_block(FILE *file, const void *data, size_t size)
+{
+    static const char zeros[RAFGL_PACK_ALIGN] = {0};
+    long at = ftell(file);
+    long pad = (RAFGL_PACK_ALIGN - at % RAFGL_PACK_ALIGN) % RAFGL_PACK_ALIGN;
+
+    fwrite(zeros, 1, pad, file);
+    fwrite(data, 1, size, file);
+
+    return (uint64_t)(at + pad);
+}
+
+int rafgl_pack_writer_open(rafgl_pack_writer_t *writer, const char *path)
+{
+    rafgl_pack_header_t header;
+
+    writer->file = fopen(path, "wb");
+    if(writer->file == NULL) return -1;
+
+    /* rewritten with the real count and index on close */
+    memset(&header, 0, sizeof(header));
+    fwrite(&header, sizeof(header), 1, writer->file);
+
+    writer->count = 0;
+    writer->capacity = 16;
+    writer->entries = malloc(writer->capacity * sizeof(rafgl_pack_entry_t));
+    return 0;
+}
+
+static rafgl_pack_entry_t *__pack_writer_add(rafgl_pack_writer_t *writer, const char *name, int type, rafgl_raster_t *raster)
+{
+    rafgl_pack_entry_t *entry;
+    rafgl_trim_t *trim = raster->trim;
+    rafgl_raster_t packed;
+
+    if(writer->count == writer->capacity)
+    {
+        writer->capacity *= 2;
+        writer->entries = realloc(writer->entries, writer->capacity * sizeof(rafgl_pack_entry_t));
+    }
+
+    entry = &writer->entries[writer->count++];
+    memset(entry, 0, sizeof(rafgl_pack_entry_t));
+    strncpy(entry->name, name, sizeof(entry->name) - 1);
+    entry->type = type;
+    entry->width = raster->width;
+    entry->height = raster->height;
+    /* a view's rows run on into the rest of its parent, it is stored as a raster of its own. packs are always linear */
+    packed = *raster;
+    if(raster->parent != NULL || raster->layout != RAFGL_LAYOUT_LINEAR)
+    {
+        packed.data = NULL;
+        rafgl_raster_copy_layout(&packed, raster, RAFGL_LAYOUT_LINEAR);
+    }
+
+    /* rows keep their padding, so views come out aligned like any other raster */
+    entry->stride = packed.stride;
+    entry->pixels = __pack_write_block(writer->file, packed.data, (size_t)packed.stride * packed.height * sizeof(rafgl_pixel_rgb_t));
+
+    if(packed.data != raster->data)
+        rafgl_raster_cleanup(&packed);
+
+    if(trim != NULL)
+    {
+        entry->cell_width = trim->cell_width;
+        entry->cell_height = trim->cell_height;
+        entry->trim = __pack_write_block(writer->file, trim->boxes, trim->cells_x * trim->cells_y * sizeof(rafgl_rect_t));
+    }
+
+    return entry;
+}
+
+int rafgl_pack_writer_add_raster(rafgl_pack_writer_t *writer, const char *name, rafgl_raster_t *raster)
+{
+    __pack_writer_add(writer, name, RAFGL_PACK_RASTER, raster);
+    return 0;
+}
+
+int rafgl_pack_writer_add_spritesheet(rafgl_pack_writer_t *writer, const char *name, rafgl_spritesheet_t *spritesheet)
+{
+    rafgl_pack_entry_t *entry = __pack_writer_add(writer, name, RAFGL_PACK_SPRITESHEET, &spritesheet->sheet);
+
+    entry->sheet_width = spritesheet->sheet_width;
+    entry->sheet_height = spritesheet->sheet_height;
+    return 0;
+}
+
+int rafgl_pack_writer_add_atlas(rafgl_pack_writer_t *writer, const char *name, rafgl_atlas_t *atlas)
+{
+    rafgl_pack_entry_t *entry = __pack_writer_add(writer, name, RAFGL_PACK_ATLAS, &atlas->raster);
+
+    entry->region_count = atlas->region_count;
+    entry->regions = __pack_write_block(writer->file, atlas->regions, atlas->region_count * sizeof(rafgl_atlas_region_t));
+    return 0;
+}
+
+int rafgl_pack_writer_close(rafgl_pack_writer_t *writer)
+{
+    rafgl_pack_header_t header;
+    int failed;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "RAFGLPAK", 8);
+    header.version = RAFGL_PACK_VERSION;
+    header.count = writer->count;
+    header.index = __pack_write_block(writer->file, writer->entries, writer->count * sizeof(rafgl_pack_entry_t));
+
+    fseek(writer->file, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, writer->file);
+
+    failed = ferror(writer->file);
+    fclose(writer->file);
+    free(writer->entries);
+    writer->file = NULL;
+    writer->entries = NULL;
+
+    return failed ? -1 : 0;
+}
+
+static void __pack_unmap(rafgl_pack_t *pack)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(pack->base);
+    CloseHandle((HANDLE)pack->mapping);
+#else
+    munmap(pack->base, pack->size);
+#endif
+    pack->base = NULL;
+    pack->size = 0;
+}
+
+int rafgl_pack_open(rafgl_pack_t *pack, const char *path)
+{
+    const rafgl_pack_header_t *header;
+
+    pack->base = NULL;
+    pack->size = 0;
+    pack->count = 0;
+    pack->entries = NULL;
+    pack->mapping = NULL;
+
+    /* private copy-on-write mapping: views can be drawn into without touching the file */
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+
+    if(file == INVALID_HANDLE_VALUE) return -1;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(rafgl_pack_header_t))
+    {
+        CloseHandle(file);
+        return -1;
+    }
+
+    pack->mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if(pack->mapping == NULL) return -1;
+
+    pack->base = MapViewOfFile((HANDLE)pack->mapping, FILE_MAP_COPY, 0, 0, 0);
+    if(pack->base == NULL)
+    {
+        CloseHandle((HANDLE)pack->mapping);
+        return -1;
+    }
+    pack->size = (size_t)size.QuadPart;
+#else
+    struct stat st;
+    void *base;
+    int fd = open(path, O_RDONLY);
+
+    if(fd < 0) return -1;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(rafgl_pack_header_t))
+    {
+        close(fd);
+        return -1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED) return -1;
+
+    pack->base = base;
+    pack->size = st.st_size;
+#endif
+
+    header = (const rafgl_pack_header_t *)pack->base;
+    if(memcmp(header->magic, "RAFGLPAK", 8) != 0 || header->version != RAFGL_PACK_VERSION || header->index > pack->size || (pack->size - header->index) / sizeof(rafgl_pack_entry_t) < header->count)
+    {
+        __pack_unmap(pack);
+        return -1;
+    }
+
+    pack->count = header->count;
+    pack->entries = (const rafgl_pack_entry_t *)(pack->base + header->index);
+    return 0;
+}
+
+int rafgl_pack_find(rafgl_pack_t *pack, const char *name)
+{
+    int i;
+
+    for(i = 0; i < pack->count; i++)
+        if(strncmp(pack->entries[i].name, name, sizeof(pack->entries[i].name)) == 0)
+            return i;
+
+    return -1;
+}
+
+/* count elements of size bytes at offset lie inside the file, written so nothing can wrap around */
+static int __pack_block_fits(rafgl_pack_t *pack, uint64_t offset, uint64_t count, size_t size)
+{
+    return offset <= pack->size && count <= (pack->size - offset) / size;
+}
+
+static int __pack_rect_fits(int x, int y, int w, int h, int width, int height)
+{
+    return x >= 0 && y >= 0 && w >= 0 && h >= 0 && x <= width && y <= height && w <= width - x && h <= height - y;
+}
+
+/* the named entry of the given type, NULL if it is missing, its blocks run past the end of the file
+   or a trim box or atlas region falls outside the pixels it describes */
+static const rafgl_pack_entry_t *__pack_entry(rafgl_pack_t *pack, const char *name, int type)
+{
+    const rafgl_pack_entry_t *entry;
+    rafgl_rect_t box;
+    rafgl_atlas_region_t region;
+    uint64_t cells = 0, c;
+    int i = rafgl_pack_find(pack, name);
+
+    if(i < 0) return NULL;
+    entry = &pack->entries[i];
+
+    if(entry->type != (uint32_t)type || entry->width <= 0 || entry->height <= 0 || entry->stride < entry->width) return NULL;
+    if(!__pack_block_fits(pack, entry->pixels, (uint64_t)entry->stride * entry->height, sizeof(rafgl_pixel_rgb_t))) return NULL;
+
+    if(entry->cell_width > 0 && entry->cell_height > 0)
+        cells = (uint64_t)(entry->width / entry->cell_width) * (entry->height / entry->cell_height);
+    if(cells > 0 && !__pack_block_fits(pack, entry->trim, cells, sizeof(rafgl_rect_t))) return NULL;
+
+    for(c = 0; c < cells; c++)
+    {
+        memcpy(&box, pack->base + entry->trim + c * sizeof(rafgl_rect_t), sizeof(box));
+        if(!__pack_rect_fits(box.x, box.y, box.width, box.height, entry->cell_width, entry->cell_height)) return NULL;
+    }
+
+    if(entry->region_count < 0 || !__pack_block_fits(pack, entry->regions, entry->region_count, sizeof(rafgl_atlas_region_t))) return NULL;
+
+    for(c = 0; c < (uint64_t)entry->region_count; c++)
+    {
+        memcpy(&region, pack->base + entry->regions + c * sizeof(rafgl_atlas_region_t), sizeof(region));
+        if(!__pack_rect_fits(region.x, region.y, region.width, region.height, entry->width, entry->height)) return NULL;
+    }
+
+    return entry;
+}
+
+static void __pack_view(rafgl_pack_t *pack, const rafgl_pack_entry_t *entry, rafgl_raster_t *raster)
+{
+    rafgl_trim_t *trim;
+    int cells;
+
+    raster->data = (rafgl_pixel_rgb_t *)(pack->base + entry->pixels);
+    raster->width = entry->width;
+    raster->height = entry->height;
+    raster->stride = entry->stride;
+    raster->spans = NULL;
+    raster->dirty = NULL;
+    raster->dirty_generation = 0;
+    raster->trim = NULL;
+    raster->borrowed = 1;
+    raster->parent = NULL;
+    raster->parent_x = raster->parent_y = 0;
+    raster->transient = 0;
+    raster->layout = RAFGL_LAYOUT_LINEAR;
+    rafgl_raster_set_clip(raster, 0, 0, raster->width, raster->height);
+
+    if(entry->cell_width <= 0 || entry->cell_height <= 0) return;
+
+    /* the boxes are tiny next to the pixels, and raster cleanup expects to free them */
+    trim = malloc(sizeof(rafgl_trim_t));
+    trim->cell_width = entry->cell_width;
+    trim->cell_height = entry->cell_height;
+    trim->cells_x = entry->width / entry->cell_width;
+    trim->cells_y = entry->height / entry->cell_height;
+    cells = trim->cells_x * trim->cells_y;
+    trim->boxes = malloc(cells * sizeof(rafgl_rect_t));
+    memcpy(trim->boxes, pack->base + entry->trim, cells * sizeof(rafgl_rect_t));
+    raster->trim = trim;
+}
+
+int rafgl_pack_raster(rafgl_pack_t *pack, const char *name, rafgl_raster_t *raster)
+{
+    const rafgl_pack_entry_t *entry = __pack_entry(pack, name, RAFGL_PACK_RASTER);
+
+    if(entry == NULL) return -1;
+    __pack_view(pack, entry, raster);
+    return 0;
+}
+
+int rafgl_pack_spritesheet(rafgl_pack_t *pack, const char *name, rafgl_spritesheet_t *spritesheet)
+{
+    const rafgl_pack_entry_t *entry = __pack_entry(pack, name, RAFGL_PACK_SPRITESHEET);
+
+    if(entry == NULL || entry->sheet_width <= 0 || entry->sheet_height <= 0) return -1;
+    __pack_view(pack, entry, &spritesheet->sheet);
+    spritesheet->sheet_width = entry->sheet_width;
+    spritesheet->sheet_height = entry->sheet_height;
+    spritesheet->frame_width = entry->width / entry->sheet_width;
+    spritesheet->frame_height = entry->height / entry->sheet_height;
+    return 0;
+}
+
+int rafgl_pack_atlas(rafgl_pack_t *pack, const char *name, rafgl_atlas_t *atlas)
+{
+    const rafgl_pack_entry_t *entry = __pack_entry(pack, name, RAFGL_PACK_ATLAS);
+
+    if(entry == NULL) return -1;
+    __pack_view(pack, entry, &atlas->raster);
+
+    /* no skyline, so every rafgl_atlas_add fails */
+    atlas->padding = 0;
+    atlas->skyline = NULL;
+    atlas->skyline_count = atlas->skyline_capacity = 0;
+
+    atlas->region_count = entry->region_count;
+    atlas->region_capacity = rafgl_max_m(entry->region_count, 1);
+    atlas->regions = malloc(atlas->region_capacity * sizeof(rafgl_atlas_region_t));
+    memcpy(atlas->regions, pack->base + entry->regions, entry->region_count * sizeof(rafgl_atlas_region_t));
+    return 0;
+}
+
+void rafgl_pack_close(rafgl_pack_t *pack)
+{
+    if(pack->base != NULL)
+        __pack_unmap(pack);
+    pack->count = 0;
+    pack->entries = NULL;
+}
+
+int rafgl_loader_init(rafgl_loader_t *loader, int capacity)
+{
+    loader->loads = malloc(rafgl_max_m(capacity, 1) * sizeof(rafgl_load_t));
+    loader->count = 0;
+    loader->capacity = capacity;
+    loader->batch = NULL;
+    return 0;
+}
+
+static int __loader_add(rafgl_loader_t *loader, const char *path, rafgl_raster_t *raster, rafgl_spritesheet_t *spritesheet, int sheet_width, int sheet_height)
+{
+    rafgl_load_t *load;
+
+    /* the workers index the array, it cannot grow once started */
+    if(loader->batch != NULL || loader->count == loader->capacity) return -1;
+
+    load = &loader->loads[loader->count];
+    strncpy(load->path, path, sizeof(load->path) - 1);
+    load->path[sizeof(load->path) - 1] = '\0';
+    load->raster = raster;
+    load->spritesheet = spritesheet;
+    load->sheet_width = sheet_width;
+    load->sheet_height = sheet_height;
+    load->state = RAFGL_LOAD_PENDING;
+
+    return loader->count++;
+}
+
+int rafgl_loader_add_image(rafgl_loader_t *loader, const char *path, rafgl_raster_t *raster)
+{
+    return __loader_add(loader, path, raster, NULL, 0, 0);
+}
+
+int rafgl_loader_add_spritesheet(rafgl_loader_t *loader, const char *path, rafgl_spritesheet_t *spritesheet, int sheet_width, int sheet_height)
+{
+    return __loader_add(loader, path, NULL, spritesheet, sheet_width, sheet_height);
+}
+
+static void __loader_run(int begin, int end, void *ctx)
+{
+    rafgl_loader_t *loader = ctx;
+    rafgl_load_t *load;
+    int i, state;
+
+    for(i = begin; i < end; i++)
+    {
+        load = &loader->loads[i];
+
+        if(load->spritesheet != NULL)
+        {
+            rafgl_spritesheet_init(load->spritesheet, load->path, load->sheet_width, load->sheet_height);
+            state = (load->spritesheet->sheet.data != NULL) ? RAFGL_LOAD_DONE : RAFGL_LOAD_FAILED;
+        }
+        else
+        {
+            state = (rafgl_raster_load_from_image(load->raster, load->path) == 0) ? RAFGL_LOAD_DONE : RAFGL_LOAD_FAILED;
+        }
+
+        /* publishes the decoded pixels along with the state */
+        __atomic_store_n(&load->state, state, __ATOMIC_RELEASE);
+    }
+}
+
+void rafgl_loader_start(rafgl_loader_t *loader)
+{
+    __job_batch_t *batch;
+
+    if(loader->batch != NULL) return;
+
+    batch = malloc(sizeof(__job_batch_t));
+    batch->fn = __loader_run;
+    batch->ctx = loader;
+    batch->remaining = 0;
+    loader->batch = batch;
+
+    /* even a single load goes to a worker, the caller keeps running while it decodes */
+    if(loader->count > 0 && !__jobs_submit(batch, loader->count, 1, 1))
+        __loader_run(0, loader->count, loader);
+}
+
+int rafgl_loader_state(rafgl_loader_t *loader, int handle)
+{
+    if(handle < 0 || handle >= loader->count) return RAFGL_LOAD_FAILED;
+    return __atomic_load_n(&loader->loads[handle].state, __ATOMIC_ACQUIRE);
+}
+
+int rafgl_loader_done(rafgl_loader_t *loader)
+{
+    if(loader->batch == NULL) return loader->count == 0;
+    return __atomic_load_n(&((__job_batch_t *)loader->batch)->remaining, __ATOMIC_ACQUIRE) == 0;
+}
+
+float rafgl_loader_progress(rafgl_loader_t *loader)
+{
+    int i, finished = 0;
+
+    if(loader->count == 0) return 1.0f;
+
+    for(i = 0; i < loader->count; i++)
+        finished += rafgl_loader_state(loader, i) != RAFGL_LOAD_PENDING;
+
+    return (float)finished / loader->count;
+}
+
+int rafgl_loader_wait(rafgl_loader_t *loader)
+{
+    int i, failed = 0;
+
+    rafgl_loader_start(loader);
+    __jobs_wait(loader->batch);
+
+    for(i = 0; i < loader->count; i++)
+        failed += rafgl_loader_state(loader, i) == RAFGL_LOAD_FAILED;
+
+    return failed ? -1 : 0;
+}
+
+void rafgl_loader_cleanup(rafgl_loader_t *loader)
+{
+    /* the workers still hold the batch and the loads */
+    if(loader->batch != NULL)
+        __jobs_wait(loader->batch);
+
+    free(loader->batch);
+    free(loader->loads);
+    loader->batch = NULL;
+    loader->loads = NULL;
+    loader->count = loader->capacity = 0;
+}
+
+static int __floor_div(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+int rafgl_tilemap_init(rafgl_tilemap_t *tilemap, int width, int height, int tile_width, int tile_height, rafgl_raster_t *tileset, int tileset_count)
+{
+    int i;
+
+    tilemap->width = width;
+    tilemap->height = height;
+    tilemap->tile_width = tile_width;
+    tilemap->tile_height = tile_height;
+    tilemap->tileset = tileset;
+    tilemap->atlas = NULL;
+    tilemap->atlas_first = 0;
+    tilemap->tileset_count = tileset_count;
+    tilemap->tint.rgba = RAFGL_COLOUR_KEY_MOJ.rgba;
+
+    tilemap->overhang = 0;
+    for(i = 0; tileset != NULL && i < tileset_count; i++)
+        tilemap->overhang = rafgl_max_m(tilemap->overhang, tileset[i].height - tile_height);
+
+    tilemap->tiles = calloc(width * height, sizeof(int));
+
+    tilemap->chunks_x = (width + RAFGL_TILEMAP_CHUNK - 1) / RAFGL_TILEMAP_CHUNK;
+    tilemap->chunks_y = (height + RAFGL_TILEMAP_CHUNK - 1) / RAFGL_TILEMAP_CHUNK;
+    tilemap->chunks = calloc(tilemap->chunks_x * tilemap->chunks_y, sizeof(rafgl_tilemap_chunk_t));
+
+    tilemap->cache_limit = 4;
+    tilemap->cached_count = 0;
+    tilemap->cached = malloc(tilemap->chunks_x * tilemap->chunks_y * sizeof(int));
+    tilemap->frame = 0;
+
+    return 0;
+}
+
+int rafgl_tilemap_init_from_atlas(rafgl_tilemap_t *tilemap, int width, int height, int tile_width, int tile_height, rafgl_atlas_t *atlas, int first_region, int tile_count)
+{
+    int i;
+
+    rafgl_tilemap_init(tilemap, width, height, tile_width, tile_height, NULL, tile_count);
+    tilemap->atlas = atlas;
+    tilemap->atlas_first = first_region;
+
+    for(i = 0; i < tile_count; i++)
+        tilemap->overhang = rafgl_max_m(tilemap->overhang, atlas->regions[first_region + i].source_height - tile_height);
+
+    return 0;
+}
+
+void rafgl_tilemap_set_cache_limit(rafgl_tilemap_t *tilemap, int chunks)
+{
+    tilemap->cache_limit = rafgl_max_m(chunks, 1);
+}
+
+int rafgl_tilemap_get_tile(rafgl_tilemap_t *tilemap, int x, int y)
+{
+    if(x < 0 || y < 0 || x >= tilemap->width || y >= tilemap->height) return -1;
+    return tilemap->tiles[y * tilemap->width + x];
+}
+
+void rafgl_tilemap_set_tile(rafgl_tilemap_t *tilemap, int x, int y, int tile)
+{
+    if(x < 0 || y < 0 || x >= tilemap->width || y >= tilemap->height) return;
+    if(tilemap->tiles[y * tilemap->width + x] == tile) return;
+
+    tilemap->tiles[y * tilemap->width + x] = tile;
+    tilemap->chunks[(y / RAFGL_TILEMAP_CHUNK) * tilemap->chunks_x + x / RAFGL_TILEMAP_CHUNK].dirty = 1;
+}
+
+void rafgl_tilemap_set_tint(rafgl_tilemap_t *tilemap, rafgl_pixel_rgb_t tint)
+{
+    tilemap->tint = tint;
+}
+
+/* renders the tiles of one chunk into its raster. the raster starts overhang pixels above the chunk so tall tiles in its
+   top row still fit, tiles are drawn row by row like a plain tile loop would. RAFGL_COLOUR_KEY_MOJ pixels are kept as they
+   are, the tint is applied when the chunk is drawn */
+static void __tilemap_render_chunk(rafgl_tilemap_t *tilemap, int cx, int cy)
+{
+    rafgl_tilemap_chunk_t *chunk = &tilemap->chunks[cy * tilemap->chunks_x + cx];
+    rafgl_raster_t *tile;
+    int x, y, x0 = cx * RAFGL_TILEMAP_CHUNK, y0 = cy * RAFGL_TILEMAP_CHUNK, t, i;
+
+    if(chunk->raster.data == NULL)
+    {
+        rafgl_raster_init(&chunk->raster, RAFGL_TILEMAP_CHUNK * tilemap->tile_width, RAFGL_TILEMAP_CHUNK * tilemap->tile_height + tilemap->overhang);
+        tilemap->cached[tilemap->cached_count++] = cy * tilemap->chunks_x + cx;
+    }
+
+    for(i = 0; i < chunk->raster.stride * chunk->raster.height; i++)
+        chunk->raster.data[i].rgba = RAFGL_COLOUR_KEY.rgba;
+
+    for(y = y0; y < rafgl_min_m(y0 + RAFGL_TILEMAP_CHUNK, tilemap->height); y++)
+    {
+        for(x = x0; x < rafgl_min_m(x0 + RAFGL_TILEMAP_CHUNK, tilemap->width); x++)
+        {
+            t = tilemap->tiles[y * tilemap->width + x];
+            if(t < 0 || t >= tilemap->tileset_count) continue;
+
+            if(tilemap->atlas != NULL)
+            {
+                rafgl_raster_draw_region(&chunk->raster, tilemap->atlas, tilemap->atlas_first + t, (x - x0) * tilemap->tile_width, tilemap->overhang + (y - y0 + 1) * tilemap->tile_height - tilemap->atlas->regions[tilemap->atlas_first + t].source_height, RAFGL_COLOUR_KEY_MOJ, 0);
+                continue;
+            }
+
+            tile = &tilemap->tileset[t];
+            rafgl_raster_draw_raster(&chunk->raster, tile, (x - x0) * tilemap->tile_width, tilemap->overhang + (y - y0 + 1) * tilemap->tile_height - tile->height, RAFGL_COLOUR_KEY_MOJ);
+        }
+    }
+
+    rafgl_raster_build_spans(&chunk->raster);
+    chunk->dirty = 0;
+}
+
+/* frees the least recently drawn chunks until the cache fits its limit, never the ones drawn this frame */
+static void __tilemap_evict(rafgl_tilemap_t *tilemap)
+{
+    rafgl_tilemap_chunk_t *chunk;
+    int i, oldest;
+
+    while(tilemap->cached_count > tilemap->cache_limit)
+    {
+        oldest = -1;
+        for(i = 0; i < tilemap->cached_count; i++)
+        {
+            chunk = &tilemap->chunks[tilemap->cached[i]];
+            if(chunk->last_used == tilemap->frame) continue;
+            if(oldest < 0 || chunk->last_used < tilemap->chunks[tilemap->cached[oldest]].last_used)
+                oldest = i;
+        }
+
+        if(oldest < 0) return;
+
+        rafgl_raster_cleanup(&tilemap->chunks[tilemap->cached[oldest]].raster);
+        tilemap->chunks[tilemap->cached[oldest]].raster.data = NULL;
+        tilemap->cached[oldest] = tilemap->cached[--tilemap->cached_count];
+    }
+}
+
+void rafgl_tilemap_draw(rafgl_tilemap_t *tilemap, rafgl_raster_t *raster, int camera_x, int camera_y)
+{
+    rafgl_tilemap_chunk_t *chunk;
+    int chunk_w = RAFGL_TILEMAP_CHUNK * tilemap->tile_width;
+    int chunk_h = RAFGL_TILEMAP_CHUNK * tilemap->tile_height;
+    int view_x = camera_x + raster->clip.x, view_y = camera_y + raster->clip.y;
+    int cx0, cx1, cy0, cy1, cx, cy;
+
+    if(raster->clip.width <= 0 || raster->clip.height <= 0) return;
+
+    /* only chunks overlapping the clip area, a chunk reaches overhang pixels above its first row */
+    cx0 = rafgl_max_m(__floor_div(view_x, chunk_w), 0);
+    cx1 = rafgl_min_m(__floor_div(view_x + raster->clip.width - 1, chunk_w), tilemap->chunks_x - 1);
+    cy0 = rafgl_max_m(__floor_div(view_y, chunk_h), 0);
+    cy1 = rafgl_min_m(__floor_div(view_y + raster->clip.height - 1 + tilemap->overhang, chunk_h), tilemap->chunks_y - 1);
+
+    tilemap->frame++;
+
+    /* the cache has to hold at least what is on screen at once */
+    if((cx1 - cx0 + 1) * (cy1 - cy0 + 1) > tilemap->cache_limit)
+        rafgl_tilemap_set_cache_limit(tilemap, (cx1 - cx0 + 1) * (cy1 - cy0 + 1));
+
+    for(cy = cy0; cy <= cy1; cy++)
+    {
+        for(cx = cx0; cx <= cx1; cx++)
+        {
+            chunk = &tilemap->chunks[cy * tilemap->chunks_x + cx];
+            if(chunk->raster.data == NULL || chunk->dirty)
+                __tilemap_render_chunk(tilemap, cx, cy);
+
+            chunk->last_used = tilemap->frame;
+            __draw_keyed(raster, &chunk->raster, 0, 0, chunk->raster.width, chunk->raster.height, 0, cx * chunk_w - camera_x, cy * chunk_h - tilemap->overhang - camera_y, 1, tilemap->tint.rgba, 0);
+        }
+    }
+
+    __tilemap_evict(tilemap);
+}
+
+void rafgl_tilemap_cleanup(rafgl_tilemap_t *tilemap)
+{
+    int i;
+
+    for(i = 0; i < tilemap->cached_count; i++)
+        rafgl_raster_cleanup(&tilemap->chunks[tilemap->cached[i]].raster);
+
+    free(tilemap->chunks);
+    free(tilemap->tiles);
+    free(tilemap->cached);
+    tilemap->chunks = NULL;
+    tilemap->tiles = NULL;
+    tilemap->cached = NULL;
+    tilemap->cached_count = 0;
+}
+
+static int __spatial_cell(const rafgl_spatial_hash_t *hash, int v)
+{
+    return __floor_div(v, hash->cell_size);
+}
+
+static int __spatial_bucket(const rafgl_spatial_hash_t *hash, int cx, int cy)
+{
+    return (int)(((unsigned)cx * 73856093u ^ (unsigned)cy * 19349663u) & (unsigned)(hash->bucket_count - 1));
+}
+
+static void __spatial_link(rafgl_spatial_hash_t *hash, int n)
+{
+    rafgl_spatial_node_t *node = &hash->nodes[n];
+    int b = __spatial_bucket(hash, node->cx, node->cy);
+
+    node->prev = -1;
+    node->next = hash->buckets[b];
+    if(node->next >= 0)
+        hash->nodes[node->next].prev = n;
+    hash->buckets[b] = n;
+}
+
+static void __spatial_unlink(rafgl_spatial_hash_t *hash, int n)
+{
+    rafgl_spatial_node_t *node = &hash->nodes[n];
+
+    if(node->prev >= 0)
+        hash->nodes[node->prev].next = node->next;
+    else
+        hash->buckets[__spatial_bucket(hash, node->cx, node->cy)] = node->next;
+
+    if(node->next >= 0)
+        hash->nodes[node->next].prev = node->prev;
+}
+
+/* twice as many buckets as items keeps the chains short, nodes are only relinked */
+static void __spatial_rehash(rafgl_spatial_hash_t *hash, int bucket_count)
+{
+    int i, n;
+
+    free(hash->buckets);
+    hash->bucket_count = bucket_count;
+    hash->buckets = malloc(bucket_count * sizeof(int));
+    for(i = 0; i < bucket_count; i++)
+        hash->buckets[i] = -1;
+
+    for(i = 0; i < hash->item_capacity; i++)
+    {
+        if(!hash->items[i].alive) continue;
+        for(n = hash->items[i].first_node; n >= 0; n = hash->nodes[n].item_next)
+            __spatial_link(hash, n);
+    }
+}
+
+static void __spatial_add_nodes(rafgl_spatial_hash_t *hash, int id)
+{
+    rafgl_spatial_item_t *item = &hash->items[id];
+    int cx, cy, n, i;
+    int cx0 = __spatial_cell(hash, item->x), cx1 = __spatial_cell(hash, item->x + rafgl_max_m(item->width, 1) - 1);
+    int cy0 = __spatial_cell(hash, item->y), cy1 = __spatial_cell(hash, item->y + rafgl_max_m(item->height, 1) - 1);
+
+    item->first_node = -1;
+
+    for(cy = cy0; cy <= cy1; cy++)
+    {
+        for(cx = cx0; cx <= cx1; cx++)
+        {
+            if(hash->free_node < 0)
+            {
+                n = hash->node_capacity;
+                hash->node_capacity *= 2;
+                hash->nodes = realloc(hash->nodes, hash->node_capacity * sizeof(rafgl_spatial_node_t));
+                for(i = n; i < hash->node_capacity; i++)
+                    hash->nodes[i].item_next = (i + 1 < hash->node_capacity) ? i + 1 : -1;
+                hash->free_node = n;
+            }
+
+            n = hash->free_node;
+            hash->free_node = hash->nodes[n].item_next;
+
+            hash->nodes[n].item = id;
+            hash->nodes[n].cx = cx;
+            hash->nodes[n].cy = cy;
+            hash->nodes[n].item_next = item->first_node;
+            item->first_node = n;
+
+            __spatial_link(hash, n);
+        }
+    }
+}
+
+static void __spatial_remove_nodes(rafgl_spatial_hash_t *hash, int id)
+{
+    int n = hash->items[id].first_node, next;
+
+    while(n >= 0)
+    {
+        next = hash->nodes[n].item_next;
+        __spatial_unlink(hash, n);
+        hash->nodes[n].item_next = hash->free_node;
+        hash->free_node = n;
+        n = next;
+    }
+
+    hash->items[id].first_node = -1;
+}
+
+int rafgl_spatial_init(rafgl_spatial_hash_t *hash, int cell_size, int capacity)
+{
+    int i, buckets = 16;
+
+    capacity = rafgl_max_m(capacity, 16);
+
+    hash->cell_size = rafgl_max_m(cell_size, 1);
+    hash->item_count = 0;
+    hash->item_capacity = capacity;
+    hash->items = malloc(capacity * sizeof(rafgl_spatial_item_t));
+    for(i = 0; i < capacity; i++)
+    {
+        hash->items[i].alive = 0;
+        hash->items[i].first_node = (i + 1 < capacity) ? i + 1 : -1;
+    }
+    hash->free_item = 0;
+
+    /* most items fit in a single cell, some straddle two or four */
+    hash->node_capacity = capacity * 2;
+    hash->nodes = malloc(hash->node_capacity * sizeof(rafgl_spatial_node_t));
+    for(i = 0; i < hash->node_capacity; i++)
+        hash->nodes[i].item_next = (i + 1 < hash->node_capacity) ? i + 1 : -1;
+    hash->free_node = 0;
+
+    while(buckets < capacity * 2) buckets *= 2;
+    hash->buckets = NULL;
+    __spatial_rehash(hash, buckets);
+
+    hash->stamp = 0;
+    return 0;
+}
+
+int rafgl_spatial_insert(rafgl_spatial_hash_t *hash, int x, int y, int width, int height)
+{
+    rafgl_spatial_item_t *item;
+    int id, i;
+
+    if(hash->free_item < 0)
+    {
+        id = hash->item_capacity;
+        hash->item_capacity *= 2;
+        hash->items = realloc(hash->items, hash->item_capacity * sizeof(rafgl_spatial_item_t));
+        for(i = id; i < hash->item_capacity; i++)
+        {
+            hash->items[i].alive = 0;
+            hash->items[i].first_node = (i + 1 < hash->item_capacity) ? i + 1 : -1;
+        }
+        hash->free_item = id;
+    }
+
+    id = hash->free_item;
+    item = &hash->items[id];
+    hash->free_item = item->first_node;
+
+    item->x = x;
+    item->y = y;
+    item->width = width;
+    item->height = height;
+    item->alive = 1;
+    item->mark = 0;
+    item->first_node = -1;
+    hash->item_count++;
+
+    if(hash->item_count * 2 > hash->bucket_count)
+        __spatial_rehash(hash, hash->bucket_count * 2);
+
+    __spatial_add_nodes(hash, id);
+    return id;
+}
+
+void rafgl_spatial_move(rafgl_spatial_hash_t *hash, int id, int x, int y, int width, int height)
+{
+    rafgl_spatial_item_t *item = &hash->items[id];
+    int same_cells;
+
+    same_cells = __spatial_cell(hash, x) == __spatial_cell(hash, item->x)
+              && __spatial_cell(hash, y) == __spatial_cell(hash, item->y)
+              && __spatial_cell(hash, x + rafgl_max_m(width, 1) - 1) == __spatial_cell(hash, item->x + rafgl_max_m(item->width, 1) - 1)
+              && __spatial_cell(hash, y + rafgl_max_m(height, 1) - 1) == __spatial_cell(hash, item->y + rafgl_max_m(item->height, 1) - 1);
+
+    /* small moves stay inside the same cells and touch nothing but the rectangle */
+    if(!same_cells)
+        __spatial_remove_nodes(hash, id);
+
+    item->x = x;
+    item->y = y;
+    item->width = width;
+    item->height = height;
+
+    if(!same_cells)
+        __spatial_add_nodes(hash, id);
+}
+
+void rafgl_spatial_remove(rafgl_spatial_hash_t *hash, int id)
+{
+    if(!hash->items[id].alive) return;
+
+    __spatial_remove_nodes(hash, id);
+    hash->items[id].alive = 0;
+    hash->items[id].first_node = hash->free_item;
+    hash->free_item = id;
+    hash->item_count--;
+}
+
+static int __spatial_overlap(const rafgl_spatial_item_t *a, int x, int y, int width, int height)
+{
+    return a->x < x + width && x < a->x + a->width && a->y < y + height && y < a->y + a->height;
+}
+
+int rafgl_spatial_query(rafgl_spatial_hash_t *hash, int x, int y, int width, int height, int *result, int max_results)
+{
+    rafgl_spatial_item_t *item;
+    int cx, cy, n, count = 0;
+    int cx0 = __spatial_cell(hash, x), cx1 = __spatial_cell(hash, x + rafgl_max_m(width, 1) - 1);
+    int cy0 = __spatial_cell(hash, y), cy1 = __spatial_cell(hash, y + rafgl_max_m(height, 1) - 1);
+
+    /* items spanning several cells are reported once, the stamp remembers who was already seen by this query */
+    hash->stamp++;
+
+    for(cy = cy0; cy <= cy1; cy++)
+    {
+        for(cx = cx0; cx <= cx1; cx++)
+        {
+            for(n = hash->buckets[__spatial_bucket(hash, cx, cy)]; n >= 0; n = hash->nodes[n].next)
+            {
+                if(hash->nodes[n].cx != cx || hash->nodes[n].cy != cy) continue;
+
+                item = &hash->items[hash->nodes[n].item];
+                if(item->mark == hash->stamp) continue;
+                item->mark = hash->stamp;
+
+                if(!__spatial_overlap(item, x, y, width, height)) continue;
+
+                if(count < max_results)
+                    result[count] = hash->nodes[n].item;
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+int rafgl_spatial_pairs(rafgl_spatial_hash_t *hash, void (*fn)(int a, int b, void *ctx), void *ctx)
+{
+    rafgl_spatial_node_t *na, *nb;
+    rafgl_spatial_item_t *a, *b;
+    int i, m, n, count = 0;
+
+    for(i = 0; i < hash->bucket_count; i++)
+    {
+        for(m = hash->buckets[i]; m >= 0; m = na->next)
+        {
+            na = &hash->nodes[m];
+            a = &hash->items[na->item];
+
+            for(n = na->next; n >= 0; n = nb->next)
+            {
+                nb = &hash->nodes[n];
+                if(nb->cx != na->cx || nb->cy != na->cy) continue;
+
+                b = &hash->items[nb->item];
+                if(!__spatial_overlap(a, b->x, b->y, b->width, b->height)) continue;
+
+                /* a pair sharing several cells is reported only from the cell holding the top left corner of the overlap */
+                if(__spatial_cell(hash, rafgl_max_m(a->x, b->x)) != na->cx || __spatial_cell(hash, rafgl_max_m(a->y, b->y)) != na->cy) continue;
+
+                if(fn != NULL)
+                    fn(rafgl_min_m(na->item, nb->item), rafgl_max_m(na->item, nb->item), ctx);
+                count++;
+            }
+        }
+    }
+
+    return count;
+}
+
+void rafgl_spatial_cleanup(rafgl_spatial_hash_t *hash)
+{
+    free(hash->items);
+    free(hash->nodes);
+    free(hash->buckets);
+    hash->items = NULL;
+    hash->nodes = NULL;
+    hash->buckets = NULL;
+    hash->item_count = hash->item_capacity = hash->node_capacity = hash->bucket_count = 0;
+}
+
+static void __entities_grow(rafgl_entities_t *store, int capacity)
+{
+    store->x = realloc(store->x, capacity * sizeof(float));
+    store->y = realloc(store->y, capacity * sizeof(float));
+    store->vx = realloc(store->vx, capacity * sizeof(float));
+    store->vy = realloc(store->vy, capacity * sizeof(float));
+    store->frame_time = realloc(store->frame_time, capacity * sizeof(float));
+    store->frame_duration = realloc(store->frame_duration, capacity * sizeof(float));
+    store->frame = realloc(store->frame, capacity * sizeof(int));
+    store->frame_count = realloc(store->frame_count, capacity * sizeof(int));
+    store->row = realloc(store->row, capacity * sizeof(int));
+    store->sprite = realloc(store->sprite, capacity * sizeof(int));
+    store->id = realloc(store->id, capacity * sizeof(int));
+    store->capacity = capacity;
+}
+
+int rafgl_entities_init(rafgl_entities_t *store, int capacity)
+{
+    memset(store, 0, sizeof(rafgl_entities_t));
+    __entities_grow(store, rafgl_max_m(capacity, 16));
+    store->free_id = -1;
+    return 0;
+}
+
+int rafgl_entities_spawn(rafgl_entities_t *store, float x, float y, int sprite, int row, int frame_count, float frame_duration)
+{
+    int i = store->count, id;
+
+    if(i == store->capacity)
+        __entities_grow(store, store->capacity * 2);
+
+    /* ids are recycled through a free list threaded through the slot table */
+    if(store->free_id >= 0)
+    {
+        id = store->free_id;
+        store->free_id = -2 - store->slot[id];
+    }
+    else
+    {
+        if(store->id_count == store->id_capacity)
+        {
+            store->id_capacity = rafgl_max_m(store->id_capacity * 2, 16);
+            store->slot = realloc(store->slot, store->id_capacity * sizeof(int));
+        }
+        id = store->id_count++;
+    }
+
+    store->x[i] = x;
+    store->y[i] = y;
+    store->vx[i] = 0.0f;
+    store->vy[i] = 0.0f;
+    store->frame[i] = 0;
+    store->frame_count[i] = rafgl_max_m(frame_count, 1);
+    store->frame_duration[i] = frame_duration;
+    store->frame_time[i] = frame_duration;
+    store->row[i] = row;
+    store->sprite[i] = sprite;
+    store->id[i] = id;
+    store->slot[id] = i;
+
+    store->count++;
+    return id;
+}
+
+void rafgl_entities_despawn(rafgl_entities_t *store, int id)
+{
+    int i = rafgl_entities_slot(store, id), last = store->count - 1;
+
+    if(i < 0) return;
+
+    /* the last entity moves into the hole, the arrays stay dense */
+    store->x[i] = store->x[last];
+    store->y[i] = store->y[last];
+    store->vx[i] = store->vx[last];
+    store->vy[i] = store->vy[last];
+    store->frame_time[i] = store->frame_time[last];
+    store->frame_duration[i] = store->frame_duration[last];
+    store->frame[i] = store->frame[last];
+    store->frame_count[i] = store->frame_count[last];
+    store->row[i] = store->row[last];
+    store->sprite[i] = store->sprite[last];
+    store->id[i] = store->id[last];
+    store->slot[store->id[i]] = i;
+
+    store->slot[id] = -2 - store->free_id;
+    store->free_id = id;
+    store->count--;
+}
+
+int rafgl_entities_slot(rafgl_entities_t *store, int id)
+{
+    if(id < 0 || id >= store->id_count || store->slot[id] < 0) return -1;
+    return store->slot[id];
+}
+
+void rafgl_entities_set_velocity(rafgl_entities_t *store, int id, float vx, float vy)
+{
+    int i = rafgl_entities_slot(store, id);
+
+    if(i < 0) return;
+    store->vx[i] = vx;
+    store->vy[i] = vy;
+}
+
+/* integrates positions and steps animations of entities [begin, end). a frame advances at most once per update */
+static void __entities_update_scalar(rafgl_entities_t *store, int begin, int end, float dt)
+{
+    int i, steps;
+    float late, duration;
+
+    for(i = begin; i < end; i++)
+    {
+        store->x[i] += store->vx[i] * dt;
+        store->y[i] += store->vy[i] * dt;
+
+        store->frame_time[i] -= dt;
+        if(store->frame_time[i] > 0.0f) continue;
+
+        late = -store->frame_time[i];
+        duration = store->frame_duration[i];
+
+        if(late < duration || duration <= 0.0f)
+        {
+            store->frame_time[i] += duration;
+            if(++store->frame[i] >= store->frame_count[i])
+                store->frame[i] = 0;
+        }
+        else
+        {
+            /* a step longer than a frame (a hitch, a paused game) skips whole loops first, then every frame it covered */
+            late = fmodf(late, duration * store->frame_count[i]);
+            steps = (int)(late / duration) + 1;
+            store->frame_time[i] = steps * duration - late;
+            store->frame[i] = (store->frame[i] + steps) % store->frame_count[i];
+        }
     }
-
-    return code;
 }
 
-void rafgl_raster_draw_line(rafgl_raster_t *raster, int x0, int y0, int x1, int y1, uint32_t colour)
-{
+#ifdef RAFGL_X86_SIMD
 
-    int xmin = 0, ymin = 0, xmax = raster->width - 1, ymax = raster->height - 1;
-    int outcode0 = __compute_outcode(x0, y0, raster);
-    int outcode1 = __compute_outcode(x1, y1, raster);
-    int accept = 0;
-    int xnew, ynew;
-    int outside_outcode;
+__attribute__((target("sse2")))
+static void __entities_update_sse2(rafgl_entities_t *store, int begin, int end, float dt)
+{
+    int i = begin;
+    __m128 t = _mm_set1_ps(dt), zero = _mm_setzero_ps();
+    __m128 ft, due, duration;
+    __m128i frame, wrap, one = _mm_set1_epi32(1);
 
-    while(1)
+    for(; i + 4 <= end; i += 4)
     {
+        ft = _mm_sub_ps(_mm_loadu_ps(store->frame_time + i), t);
+        duration = _mm_loadu_ps(store->frame_duration + i);
 
-        if(!(outcode0 | outcode1))
+        /* lanes more than a whole frame late are rare, the scalar code skips their frames with a division */
+        if(_mm_movemask_ps(_mm_cmple_ps(ft, _mm_sub_ps(zero, duration))))
         {
-            /* trivijalno prihvatanje */
-            accept = 1;
-            break;
-        }
-        else if(outcode0 & outcode1)
-        {
-            /* trivijalno odbacivanje */
-            break;
+            __entities_update_scalar(store, i, i + 4, dt);
+            continue;
         }
-        else
-        {
-            outside_outcode = outcode0 ? outcode0 : outcode1;
-            if(outside_outcode & __cohsuth_TOP)
-            {
-                xnew = x0 + (x1 - x0) * (ymax - y0) / (y1 - y0);
-                ynew = ymax;
-            }
-            else if(outside_outcode & __cohsuth_BOTTOM)
-            {
-                xnew = x0 + (x1 - x0) * (ymin - y0) / (y1 - y0);
-				ynew = ymin;
-            }
-            else if (outside_outcode & __cohsuth_RIGHT)
-            {
-				ynew = y0 + (y1 - y0) * (xmax - x0) / (x1 - x0);
-				xnew = xmax;
-			}
-			else if (outside_outcode & __cohsuth_LEFT)
-            {
-				ynew = y0 + (y1 - y0) * (xmin - x0) / (x1 - x0);
-				xnew = xmin;
-			}
 
-			if(outside_outcode == outcode0)
-            {
-                x0 = xnew;
-                y0 = ynew;
-                outcode0 = __compute_outcode(x0, y0, raster);
-            }
-            else
-            {
-                x1 = xnew;
-                y1 = ynew;
-                outcode1 = __compute_outcode(x1, y1, raster);
-            }
-        }
+        _mm_storeu_ps(store->x + i, _mm_add_ps(_mm_loadu_ps(store->x + i), _mm_mul_ps(_mm_loadu_ps(store->vx + i), t)));
+        _mm_storeu_ps(store->y + i, _mm_add_ps(_mm_loadu_ps(store->y + i), _mm_mul_ps(_mm_loadu_ps(store->vy + i), t)));
 
+        due = _mm_cmple_ps(ft, zero);
+        ft = _mm_add_ps(ft, _mm_and_ps(due, duration));
+        _mm_storeu_ps(store->frame_time + i, ft);
 
+        /* due lanes are all ones, subtracting them adds one to the frame */
+        frame = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)(store->frame + i)), _mm_castps_si128(due));
+        wrap = _mm_cmpgt_epi32(_mm_add_epi32(frame, one), _mm_loadu_si128((const __m128i *)(store->frame_count + i)));
+        frame = _mm_andnot_si128(wrap, frame);
+        _mm_storeu_si128((__m128i *)(store->frame + i), frame);
     }
 
+    __entities_update_scalar(store, i, end, dt);
+}
 
-    if(!accept)
+#endif // RAFGL_X86_SIMD
+
+static void (*__entities_update_impl)(rafgl_entities_t *, int, int, float) = __entities_update_scalar;
+
+/* picks every SIMD kernel once. the first caller sets the pointers, anyone racing it waits until they are all in */
+static void __cpu_dispatch_init(void)
+{
+    int expected = 0;
+
+    if(!__atomic_compare_exchange_n(&__cpu_dispatch_state, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        while(__atomic_load_n(&__cpu_dispatch_state, __ATOMIC_ACQUIRE) == 1)
+            __thread_yield();
         return;
+    }
 
-    x0 = rafgl_clampi(x0, 0, xmax);
-    y0 = rafgl_clampi(y0, 0, ymax);
-    x1 = rafgl_clampi(x1, 0, xmax);
-    y1 = rafgl_clampi(y1, 0, ymax);
+#ifdef RAFGL_X86_SIMD
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+        __blit_row_keyed_impl = __blit_row_keyed_avx2;
+    else if(__builtin_cpu_supports("sse2"))
+        __blit_row_keyed_impl = __blit_row_keyed_sse2;
 
+    if(__builtin_cpu_supports("sse2"))
+    {
+        __blit_row_keyed_reversed_impl = __blit_row_keyed_reversed_sse2;
+        __upsample_row_horizontal_impl = __upsample_row_horizontal_sse2;
+        __upsample_row_vertical_impl = __upsample_row_vertical_sse2;
+        __planar_kernels.split = __planar_split_sse2;
+        __planar_kernels.join = __planar_join_sse2;
+        __planar_kernels.brightness = __planar_brightness_sse2;
+        __planar_kernels.lerp = __planar_lerp_sse2;
+        __entities_update_impl = __entities_update_sse2;
+    }
+#endif
 
-    /* printf("---\nx0: %d\ny0: %d\nx1: %d\ny1: %d\n", x0, y0, x1, y1); */
+    __atomic_store_n(&__cpu_dispatch_state, 2, __ATOMIC_RELEASE);
+}
 
-    int dx =  rafgl_abs_m((x1-x0)), sx = x0<x1 ? 1 : -1;
-    int dy = -rafgl_abs_m((y1-y0)), sy = y0<y1 ? 1 : -1;
-    int err = dx+dy, e2; /* error value e_xy */
+void rafgl_entities_update(rafgl_entities_t *store, float dt)
+{
+    __cpu_dispatch();
+    __entities_update_impl(store, 0, store->count, dt);
+}
 
-    while(1)
+void rafgl_entities_draw(rafgl_entities_t *store, rafgl_raster_t *raster, rafgl_spritesheet_t *sheets, int camera_x, int camera_y)
+{
+    rafgl_spritesheet_t *sheet;
+    int i, x, y;
+    int x0 = raster->clip.x + camera_x, x1 = x0 + raster->clip.width;
+    int y0 = raster->clip.y + camera_y, y1 = y0 + raster->clip.height;
+
+    for(i = 0; i < store->count; i++)
     {
-        pixel_at_pm(raster, x0, y0).rgba = colour;
-        if (x0==x1 && y0==y1) break;
-        e2 = 2*err;
-        if (e2 >= dy) { err += dy; x0 += sx; } /* e_xy+e_x > 0 */
-        if (e2 <= dx) { err += dx; y0 += sy; } /* e_xy+e_y < 0 */
+        sheet = &sheets[store->sprite[i]];
+        x = (int)store->x[i];
+        y = (int)store->y[i];
+
+        if(x >= x1 || y >= y1 || x + sheet->frame_width <= x0 || y + sheet->frame_height <= y0) continue;
+
+        rafgl_raster_draw_spritesheet(raster, sheet, store->frame[i], store->row[i], x - camera_x, y - camera_y);
     }
+}
 
+void rafgl_entities_cleanup(rafgl_entities_t *store)
+{
+    free(store->x);
+    free(store->y);
+    free(store->vx);
+    free(store->vy);
+    free(store->frame_time);
+    free(store->frame_duration);
+    free(store->frame);
+    free(store->frame_count);
+    free(store->row);
+    free(store->sprite);
+    free(store->id);
+    free(store->slot);
+    memset(store, 0, sizeof(rafgl_entities_t));
 }
 
-/* DOES NOT DO CLIPPING! */
-void rafgl_raster_draw_circle(rafgl_raster_t *raster, int cx, int cy, int r, uint32_t colour)
+int rafgl_anim_clip_init(rafgl_anim_clip_t *clip, rafgl_spritesheet_t *sheet, int frame_count, int loop)
 {
-    int x = -r, y = 0, err = 2-2*r; /* II. Quadrant */
-    do {
-        pixel_at_pm(raster, cx-x, cy+y).rgba = colour; /*   I. Quadrant */
-        pixel_at_pm(raster, cx-y, cy-x).rgba = colour; /*  II. Quadrant */
-        pixel_at_pm(raster, cx+x, cy-y).rgba = colour; /* III. Quadrant */
-        pixel_at_pm(raster, cx+y, cy+x).rgba = colour; /*  IV. Quadrant */
-        r = err;
-        if (r <= y) err += ++y*2+1;           /* e_xy+e_y < 0 */
-        if (r > x || err > y) err += ++x*2+1; /* e_xy+e_x > 0 or no 2nd y-step */
-    } while (x < 0);
+    clip->sheet = sheet;
+    clip->frame_count = frame_count;
+    clip->frames = calloc(frame_count, sizeof(rafgl_anim_frame_t));
+    clip->loop = loop;
+    clip->length = 0.0f;
+    return 0;
 }
 
-void rafgl_raster_draw_rectangle(rafgl_raster_t *raster, int x0, int y0, int w, int h, uint32_t colour)
+int rafgl_anim_clip_init_row(rafgl_anim_clip_t *clip, rafgl_spritesheet_t *sheet, int sheet_y, int first, int frame_count, float frame_duration, int loop)
 {
-    rafgl_raster_draw_line(raster, x0, y0, x0 + w, y0, colour);
-    rafgl_raster_draw_line(raster, x0, y0 + h, x0 + w, y0 + h, colour);
-    rafgl_raster_draw_line(raster, x0, y0, x0, y0 + h, colour);
-    rafgl_raster_draw_line(raster, x0 + w, y0, x0 + w, y0 + h, colour);
+    int i;
+
+    rafgl_anim_clip_init(clip, sheet, frame_count, loop);
+    for(i = 0; i < frame_count; i++)
+        rafgl_anim_clip_set_frame(clip, i, first + i, sheet_y, frame_duration);
+    return 0;
 }
 
-void rafgl_raster_bilinear_upsample(rafgl_raster_t *to, rafgl_raster_t *from)
+void rafgl_anim_clip_set_frame(rafgl_anim_clip_t *clip, int index, int sheet_x, int sheet_y, float duration)
 {
-    int x, y;
-    int w = to->width, h = to->height;
-    float xn, yn;
+    rafgl_anim_frame_t *frame = &clip->frames[index];
 
-    for(y = 0; y < h; y++)
+    clip->length -= frame->duration;
+    frame->sheet_x = sheet_x;
+    frame->sheet_y = sheet_y;
+    frame->duration = duration;
+    clip->length += duration;
+}
+
+void rafgl_anim_clip_cleanup(rafgl_anim_clip_t *clip)
+{
+    free(clip->frames);
+    clip->frames = NULL;
+    clip->frame_count = 0;
+}
+
+void rafgl_animator_play(rafgl_animator_t *animator, const rafgl_anim_clip_t *clip)
+{
+    animator->clip = clip;
+    animator->frame = 0;
+    animator->time = 0.0f;
+    animator->speed = 1.0f;
+    animator->playing = 1;
+}
+
+void rafgl_animator_update(rafgl_animator_t *animators, int count, float dt)
+{
+    rafgl_animator_t *a;
+    const rafgl_anim_clip_t *clip;
+    int i;
+
+    for(i = 0; i < count; i++)
     {
-        yn = ((float)y) / h;
-        for(x = 0; x < w; x++)
+        a = &animators[i];
+        clip = a->clip;
+        if(!a->playing || clip == NULL || clip->frame_count == 0) continue;
+
+        a->time += dt * a->speed;
+
+        /* a long step on a looping clip skips the whole loops first, so the walk below stays short */
+        if(clip->loop && clip->length > 0.0f && a->time >= clip->length)
+            a->time = fmodf(a->time, clip->length);
+
+        while(a->time >= clip->frames[a->frame].duration)
         {
-            xn = ((float)x) / w;
-            pixel_at_pm(to, x, y) = rafgl_bilinear_sample(from, xn, yn);
+            a->time -= clip->frames[a->frame].duration;
+
+            if(++a->frame == clip->frame_count)
+            {
+                if(clip->loop)
+                {
+                    a->frame = 0;
+                }
+                else
+                {
+                    /* one-shot clips hold their last frame */
+                    a->frame = clip->frame_count - 1;
+                    a->time = 0.0f;
+                    a->playing = 0;
+                    break;
+                }
+            }
+
+            if(clip->length <= 0.0f) break;
         }
     }
 }
 
+int rafgl_animator_sheet_x(const rafgl_animator_t *animator)
+{
+    return animator->clip->frames[animator->frame].sheet_x;
+}
+
+int rafgl_animator_sheet_y(const rafgl_animator_t *animator)
+{
+    return animator->clip->frames[animator->frame].sheet_y;
+}
+
+void rafgl_animator_draw(const rafgl_animator_t *animator, rafgl_raster_t *raster, int x, int y, int flags)
+{
+    const rafgl_anim_frame_t *frame;
+
+    if(animator->clip == NULL || animator->clip->frame_count == 0) return;
+
+    frame = &animator->clip->frames[animator->frame];
+    rafgl_raster_draw_spritesheet_flipped(raster, animator->clip->sheet, frame->sheet_x, frame->sheet_y, x, y, flags);
+}
+
 
 void rafgl_game_add_game_state(rafgl_game_t *game, void (*init)(GLFWwindow *window, void *args), void (*update)(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args), void (*render)(GLFWwindow *window, void *args), void (*cleanup)(GLFWwindow *window, void *args))
 {
@@ -763,53 +5772,75 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
     game_data.keys_down = __keys_down;
     game_data.keys_pressed = __keys_pressed;
 
+    __frame_thread = 1;
     current_state->init(game->window, args);
 
 
     double current_frame, last_frame;
     float elapsed;
 
-    last_frame = glfwGetTime();
+    last_frame = rafgl_clock_get();
 
     int fbwidth, fbheight, fbwlast = 0, fbhlast = 0;
+    int frames = 0;
 
-    while(!glfwWindowShouldClose(game->window))
+    while(!__quit_requested && (game->frame_limit <= 0 || frames < game->frame_limit) && (game->headless || !glfwWindowShouldClose(game->window)))
     {
         for(i = 0; i < 400; i++)
         {
             __keys_pressed[i] = 0;
         }
-        glfwPollEvents();
-
-        current_frame = glfwGetTime();
-        elapsed = current_frame - last_frame;
-        last_frame = current_frame;
 
+        if(game->headless)
+        {
+            /* no input, the clock moves by exactly one step per frame */
+            __clock_time += __clock_step;
 
-        glfwGetFramebufferSize(game->window, &fbwidth, &fbheight);
-        if(fbwlast != fbwidth || fbhlast != fbheight)
+            fbwidth = __headless_framebuffer.width;
+            fbheight = __headless_framebuffer.height;
+            game_data.mouse_pos_x = game_data.mouse_pos_y = 0.0;
+            game_data.is_lmb_down = game_data.is_rmb_down = game_data.is_mmb_down = 0;
+        }
+        else
         {
-            glViewport(0, 0, fbwidth, fbheight);
+            glfwPollEvents();
+
+            glfwGetFramebufferSize(game->window, &fbwidth, &fbheight);
+            if(fbwlast != fbwidth || fbhlast != fbheight)
+            {
+                glViewport(0, 0, fbwidth, fbheight);
+            }
+            fbwlast = fbwidth;
+            fbhlast = fbheight;
+
+            glfwGetCursorPos(game->window, &game_data.mouse_pos_x, &game_data.mouse_pos_y);
+
+            game_data.is_lmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_LEFT);
+            game_data.is_rmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_RIGHT);
+            game_data.is_mmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_MIDDLE);
         }
-        fbwlast = fbwidth;
-        fbhlast = fbheight;
+
+        current_frame = rafgl_clock_get();
+        elapsed = current_frame - last_frame;
+        last_frame = current_frame;
 
         game_data.raster_width = fbwidth;
         game_data.raster_height = fbheight;
 
-        glfwGetCursorPos(game->window, &game_data.mouse_pos_x, &game_data.mouse_pos_y);
-
-        game_data.is_lmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_LEFT);
-        game_data.is_rmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_RIGHT);
-        game_data.is_mmb_down = glfwGetMouseButton(game->window, GLFW_MOUSE_BUTTON_MIDDLE);
-
+        __frame_arena.in_frame = 1;
         current_state->update(game->window, elapsed, &game_data, args);
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        if(!game->headless)
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         current_state->render(game->window, args);
 
-        glfwSwapBuffers(game->window);
+        if(!game->headless)
+            glfwSwapBuffers(game->window);
+
+        rafgl_frame_arena_reset();
+        __frame_arena.in_frame = 0;
+        frames++;
 
         if(__game_state_change_request == current_game_state_index)
         {
@@ -831,15 +5862,16 @@ void rafgl_game_start(rafgl_game_t *game, void *_args)
             __game_state_change_request = -1;
 
             current_state->init(game->window, args);
-            last_frame = glfwGetTime();
+            last_frame = rafgl_clock_get();
 
         }
 
     }
 
+    rafgl_jobs_cleanup();
 
-}
 
+}
 
 
 /* Helpers implementation*/
@@ -862,6 +5894,12 @@ void rafgl_button_show(rafgl_raster_t *target, rafgl_button_t *btn)
 {
     int x, y, X, Y;
 
+    /* pixels past the edge are clamped onto it, so the written area is the clamped one */
+    x = rafgl_clampi(btn->posx - btn->w/2, 0, target->width - 1);
+    y = rafgl_clampi(btn->posy - btn->h/2, 0, target->height - 1);
+    if(btn->w/2 > 0 && btn->h/2 > 0)
+        rafgl_raster_mark_dirty(target, x, y, rafgl_clampi(btn->posx + btn->w/2 - 1, 0, target->width - 1) - x + 1, rafgl_clampi(btn->posy + btn->h/2 - 1, 0, target->height - 1) - y + 1);
+
     for(Y = -btn->h/2; Y < btn->h/2; Y++)
     {
         for(X = -btn->w/2; X < btn->w/2; X++)
@@ -1004,8 +6042,37 @@ rafgl_pixel_rgb_t rafgl_bilinear_sample(rafgl_raster_t *src, float u, float v)
 
 void rafgl_texture_init(rafgl_texture_t *tex)
 {
+    static GLuint headless_ids = 0;
     GLuint tx;
-    glGenTextures(1, &tx);
+    int i;
+
+    tex->capture.data = NULL;
+    tex->capture.width = tex->capture.height = tex->capture.stride = 0;
+    tex->capture.spans = NULL;
+    tex->capture.dirty = NULL;
+    tex->capture.dirty_generation = 0;
+    tex->capture.trim = NULL;
+    tex->capture.borrowed = 0;
+    tex->capture.parent = NULL;
+    tex->capture.parent_x = tex->capture.parent_y = 0;
+    tex->capture.transient = 0;
+    tex->capture.layout = RAFGL_LAYOUT_LINEAR;
+    tex->source = NULL;
+    tex->source_generation = 0;
+
+    tex->upload_mode = RAFGL_UPLOAD_DIRECT;
+    for(i = 0; i < RAFGL_UPLOAD_RING_SIZE; i++)
+    {
+        tex->pbo[i] = 0;
+        tex->fences[i] = NULL;
+    }
+    tex->pbo_index = tex->pbo_size = 0;
+    memset(&tex->stats, 0, sizeof(tex->stats));
+
+    if(__headless)
+        tx = ++headless_ids;
+    else
+        glGenTextures(1, &tx);
     tex->channels = 0;
     tex->width = 0;
     tex->height = 0;
@@ -1019,20 +6086,217 @@ int rafgl_texture_load_basic(const char *texture_path, rafgl_texture_t *res)
 
 
 
+void rafgl_texture_set_upload_mode(rafgl_texture_t *texture, int mode)
+{
+    texture->upload_mode = mode;
+}
+
+/* waits until the GPU has consumed the ring slot, returns the seconds spent blocked */
+static double __texture_wait_slot(rafgl_texture_t *texture, int slot)
+{
+    double start;
+    GLenum result;
+
+    if(texture->fences[slot] == NULL) return 0.0;
+
+    start = glfwGetTime();
+    do
+    {
+        result = glClientWaitSync(texture->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    } while(result == GL_TIMEOUT_EXPIRED);
+
+    glDeleteSync(texture->fences[slot]);
+    texture->fences[slot] = NULL;
+
+    return glfwGetTime() - start;
+}
+
+static void __texture_release_ring(rafgl_texture_t *texture)
+{
+    int i;
+
+    for(i = 0; i < RAFGL_UPLOAD_RING_SIZE; i++)
+    {
+        if(texture->fences[i] != NULL)
+            glDeleteSync(texture->fences[i]);
+        texture->fences[i] = NULL;
+    }
+
+    if(texture->pbo[0] != 0)
+        glDeleteBuffers(RAFGL_UPLOAD_RING_SIZE, texture->pbo);
+
+    for(i = 0; i < RAFGL_UPLOAD_RING_SIZE; i++)
+        texture->pbo[i] = 0;
+    texture->pbo_size = 0;
+    texture->pbo_index = 0;
+}
+
+/* uploads the given rectangles of the raster to the bound texture. pixels come from base, which is either the raster
+   data itself or offset 0 of a bound unpack buffer holding a copy of it */
+static void __texture_upload_rects(rafgl_raster_t *raster, const rafgl_rect_t *rects, int count, const void *base)
+{
+    int i;
+
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, raster->stride);
+    for(i = 0; i < count; i++)
+    {
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, rects[i].x);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, rects[i].y);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rects[i].x, rects[i].y, rects[i].width, rects[i].height, GL_RGBA, GL_UNSIGNED_BYTE, base);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+}
+
+/* copies the rectangles into the next buffer of the ring and queues the texture update from it. the copy out of the
+   buffer runs on the GPU while the CPU moves on to the next frame, the fence tells when the slot can be written again */
+static void __texture_upload_pbo(rafgl_texture_t *texture, rafgl_raster_t *raster, const rafgl_rect_t *rects, int count)
+{
+    int i, y, slot, offset;
+    int size = raster->stride * raster->height * sizeof(rafgl_pixel_rgb_t);
+    rafgl_pixel_rgb_t *mapped;
+
+    if(texture->pbo_size != size)
+    {
+        __texture_release_ring(texture);
+
+        glGenBuffers(RAFGL_UPLOAD_RING_SIZE, texture->pbo);
+        for(i = 0; i < RAFGL_UPLOAD_RING_SIZE; i++)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->pbo[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        texture->pbo_size = size;
+    }
+
+    slot = texture->pbo_index;
+    texture->pbo_index = (slot + 1) % RAFGL_UPLOAD_RING_SIZE;
+
+    texture->stats.fence_wait_time = __texture_wait_slot(texture, slot);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, texture->pbo[slot]);
+
+    /* the fence already guarantees the GPU is done with this slot, no need for the driver to synchronize again.
+       only the rectangles are written, the rest of the slot is never read */
+    mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(mapped != NULL)
+    {
+        for(i = 0; i < count; i++)
+        {
+            /* a view's row tails are its parent's pixels, and its last row can end where the parent does */
+            if(rects[i].width == raster->width && raster->parent == NULL)
+            {
+                offset = rects[i].y * raster->stride;
+                memcpy(mapped + offset, raster->data + offset, raster->stride * rects[i].height * sizeof(rafgl_pixel_rgb_t));
+                continue;
+            }
+
+            for(y = rects[i].y; y < rects[i].y + rects[i].height; y++)
+            {
+                offset = y * raster->stride + rects[i].x;
+                memcpy(mapped + offset, raster->data + offset, rects[i].width * sizeof(rafgl_pixel_rgb_t));
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        __texture_upload_rects(raster, rects, count, (void *)0);
+        texture->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if(mapped == NULL)
+        __texture_upload_rects(raster, rects, count, raster->data);
+}
+
 void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *raster)
 {
     GLuint tex_slot = texture->tex_id;
+    double start;
+    rafgl_rect_t whole;
+    const rafgl_rect_t *rects = &whole;
+    int count = 1;
+    rafgl_raster_t linear;
+    __scratch_t scratch;
+
+    /* GL only reads rows, tiled rasters are uploaded whole from a linear copy */
+    if(raster->layout != RAFGL_LAYOUT_LINEAR)
+    {
+        __raster_init_scratch(&linear, raster->width, raster->height, &scratch);
+        rafgl_raster_copy_layout(&linear, raster, RAFGL_LAYOUT_LINEAR);
+        rafgl_texture_load_from_raster(texture, &linear);
+        rafgl_raster_clear_dirty(raster);
+        __scratch_end(&scratch);
+        /* the copy is gone, and a tiled raster always goes up whole */
+        texture->source = NULL;
+        return;
+    }
+
+    whole.x = whole.y = 0;
+    whole.width = raster->width;
+    whole.height = raster->height;
+
+    if(__headless)
+    {
+        rafgl_raster_copy(&texture->capture, raster);
+        rafgl_raster_clear_dirty(raster);
+        texture->width = raster->width;
+        texture->height = raster->height;
+        texture->channels = 3;
+        return;
+    }
+
+    start = glfwGetTime();
+
     glBindTexture(GL_TEXTURE_2D, tex_slot);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    /* storage and sampler state are specified once per size, every other frame only streams the pixels in */
+    if(texture->width != raster->width || texture->height != raster->height)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, raster->width, raster->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    }
+    /* the dirty list only describes what changed since the raster was last uploaded or cleared anywhere. it is enough only
+       when that was this texture's own upload, otherwise an A, B, A sequence or another consumer would leave stale areas */
+    else if((texture->upload_mode & RAFGL_UPLOAD_DIRTY) && raster->dirty != NULL && texture->source == raster &&
+            texture->source_generation == raster->dirty_generation)
+    {
+        count = rafgl_raster_merge_dirty(raster);
+        rects = raster->dirty->rects;
+    }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, raster->width, raster->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, raster->data);
+    if(count > 0)
+    {
+        if(texture->upload_mode & RAFGL_UPLOAD_PBO)
+        {
+            __texture_upload_pbo(texture, raster, rects, count);
+        }
+        else
+        {
+            texture->stats.fence_wait_time = 0.0;
+            __texture_upload_rects(raster, rects, count, raster->data);
+        }
+    }
+    else
+    {
+        texture->stats.fence_wait_time = 0.0;
+    }
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
+    rafgl_raster_clear_dirty(raster);
+
+    texture->stats.upload_time = glfwGetTime() - start;
+    texture->stats.upload_time_total += texture->stats.upload_time;
+    texture->stats.fence_wait_time_total += texture->stats.fence_wait_time;
+    texture->stats.uploads++;
+
+    texture->source = raster;
+    texture->source_generation = raster->dirty_generation;
     texture->tex_id = tex_slot;
     texture->width = raster->width;
     texture->height = raster->height;
@@ -1042,6 +6306,16 @@ void rafgl_texture_load_from_raster(rafgl_texture_t *texture, rafgl_raster_t *ra
 
 void rafgl_texture_show(const rafgl_texture_t *texture)
 {
+    if(__headless)
+    {
+        /* the quad covers the whole screen, stretched with linear filtering like the GL sampler */
+        if(texture->capture.data == NULL) return;
+        if(texture->capture.width == __headless_framebuffer.width && texture->capture.height == __headless_framebuffer.height)
+            memcpy(__headless_framebuffer.data, texture->capture.data, (size_t)texture->capture.stride * texture->capture.height * sizeof(rafgl_pixel_rgb_t));
+        else
+            rafgl_raster_bilinear_upsample(&__headless_framebuffer, (rafgl_raster_t *)&texture->capture);
+        return;
+    }
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture->tex_id);
@@ -1060,7 +6334,15 @@ void rafgl_texture_show(const rafgl_texture_t *texture)
 
 void rafgl_texture_cleanup(rafgl_texture_t *texture)
 {
-    glDeleteTextures(1, &(texture->tex_id));
+    if(texture->capture.data != NULL)
+        rafgl_raster_cleanup(&texture->capture);
+    texture->capture.data = NULL;
+
+    if(!__headless)
+    {
+        __texture_release_ring(texture);
+        glDeleteTextures(1, &(texture->tex_id));
+    }
     texture->channels = 0;
     texture->height = 0;
     texture->width = 0;
@@ -1210,6 +6492,9 @@ GLuint rafgl_program_create_from_source(const char *vertex_source, const char *f
     int success;
     char info_log[512];
 
+    /* nothing to compile against without a context */
+    if(__headless) return 0;
+
     vert = glCreateShader(GL_VERTEX_SHADER);
     glShaderSource(vert, 1, &vertex_source, NULL);
     glCompileShader(vert);
@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -16,8 +18,30 @@ int main(int argc, char *argv[])
 
 
     rafgl_game_t game;
+    long headless_frames = -1;
+    char *end;
+
+    /* --headless N renders N frames without opening a window, N has to be positive or it would never stop */
+    if(argc > 1 && strcmp(argv[1], "--headless") == 0)
+    {
+        headless_frames = (argc > 2) ? strtol(argv[2], &end, 10) : 0;
+        if(argc <= 2 || *end != '\0' || headless_frames <= 0 || headless_frames > INT_MAX)
+        {
+            fprintf(stderr, "usage: %s [--headless <frames>], frames > 0\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(headless_frames > 0)
+    {
+        rafgl_game_init_headless(&game, RASTER_WIDTH, RASTER_HEIGHT);
+        rafgl_game_set_frame_limit(&game, (int)headless_frames);
+    }
+    else
+    {
+        rafgl_game_init(&game, "main", RASTER_WIDTH, RASTER_HEIGHT, 0);
+    }
 
-    rafgl_game_init(&game, "main", RASTER_WIDTH, RASTER_HEIGHT, 0);
     rafgl_game_add_game_state(&game, main_state_init, main_state_update, main_state_render, main_state_cleanup);
     rafgl_game_add_named_game_state(&game, main_state);
     rafgl_game_start(&game, NULL);
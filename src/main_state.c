@@ -1,6 +1,7 @@
 #include <main_state.h>
 #include <glad/glad.h>
 #include <math.h>
+#include <sys/stat.h>
 
 #include <rafgl.h>
 
@@ -10,38 +11,48 @@ static rafgl_raster_t doge;
 static rafgl_raster_t upscaled_doge;
 static rafgl_raster_t raster, raster2;
 static rafgl_raster_t checker;
-static rafgl_raster_t mushroom;
+
+// sve plocice i pecurka su spakovane u jedan atlas
+static rafgl_atlas_t atlas;
+static int first_tile_region, mushroom_region;
 
 static rafgl_texture_t texture;
 
+// slojevi: pozadina i plocice se kesiraju, sprajtovi se crtaju svaki frejm
+static rafgl_compositor_t compositor;
+static int layer_background, layer_tiles, layer_sprites;
+
 static rafgl_spritesheet_t hero;
-static rafgl_spritesheet_t hero_veci;
-static rafgl_spritesheet_t hero_veci_flipped;
 static rafgl_spritesheet_t explosion;
 
-static rafgl_raster_t upscaled_hero;
-static rafgl_raster_t upscaled_hero_flipped;
-
 static rafgl_pixel_rgb_t boja;//.rgba = rafgl_RGBA(0, 255, 255, 0);
 
 
-static int upscaled_hero_width = 0, upscaled_hero_height = 0;
+static int hero_veci_width = 0, hero_veci_height = 0;
+
+// animacije: hod heroja (kolona lista, red je smer) i eksplozija preko oba reda lista
+#define ANIMATION_FRAME_TIME 0.1f
+static rafgl_anim_clip_t hero_clip, explosion_clip;
+static rafgl_animator_t hero_anim, explosion_anim;
 
 
 #define NUMBER_OF_TILES 17
-rafgl_raster_t tiles[NUMBER_OF_TILES];
 
 #define TILE_SIZE 64
 
-#define WORLD_HEIGHT RASTER_HEIGHT/TILE_SIZE
-#define WORLD_WIDTH RASTER_WIDTH/TILE_SIZE
-
 #define MUSHROOM_HEIGHT 80
 #define MUSHROOM_WIDTH 60
 
 
 #define WORLD_SIZE 128
-int tile_world[WORLD_HEIGHT][WORLD_WIDTH];
+static rafgl_tilemap_t tilemap;
+
+// tela za sudare, heroj i pecurka
+static rafgl_spatial_hash_t colliders;
+static int hero_body, mushroom_body;
+
+// kamera prati heroja po svetu od WORLD_SIZE x WORLD_SIZE plocica
+static int camera_x = 0, camera_y = 0;
 
 static int raster_width = RASTER_WIDTH, raster_height = RASTER_HEIGHT;
 
@@ -50,92 +61,407 @@ void init_tilemap(void)
 {
     int x, y;
 
-    for(y = 0; y < WORLD_HEIGHT; y++)
+    rafgl_tilemap_init_from_atlas(&tilemap, WORLD_SIZE, WORLD_SIZE, TILE_SIZE, TILE_SIZE, &atlas, first_tile_region, NUMBER_OF_TILES);
+    rafgl_tilemap_set_tint(&tilemap, boja);
+
+    for(y = 0; y < WORLD_SIZE; y++)
     {
-        for(x = 0; x < WORLD_WIDTH; x++)
+        for(x = 0; x < WORLD_SIZE; x++)
         {
             if(randf() > 0.7f)
             {
-                tile_world[y][x] = 3 + rand() % 3;
+                rafgl_tilemap_set_tile(&tilemap, x, y, 3 + rand() % 3);
             }
             else
             {
-                tile_world[y][x] = rand() % 3;
+                rafgl_tilemap_set_tile(&tilemap, x, y, rand() % 3);
             }
         }
     }
 }
 
-void render_tilemap(rafgl_raster_t *raster)
+// crta samo vidljive delove mape, kompozitor je vec odsekao sve van oblasti
+void render_tilemap(rafgl_raster_t *raster, const rafgl_rect_t *area, void *ctx)
 {
-    int x, y;
+    rafgl_tilemap_draw(&tilemap, raster, camera_x, camera_y);
+}
 
-    rafgl_raster_t *draw_tile;
+void render_background(rafgl_raster_t *raster, const rafgl_rect_t *area, void *ctx)
+{
+    int y;
 
-    for(y = 0; y < WORLD_HEIGHT; y++) {
+    for(y = area->y; y < area->y + area->height; y++)
+        memcpy(&pixel_at_pm(raster, area->x, y), &pixel_at_m(upscaled_doge, area->x, y), area->width * sizeof(rafgl_pixel_rgb_t));
+}
 
-        for(x = 0; x < WORLD_WIDTH; x++) {
-            draw_tile = tiles + (tile_world[y][x] % NUMBER_OF_TILES);
-            //boja.rgba = rafgl_RGB(0, 128, 0);
-            rafgl_raster_draw_raster(raster, draw_tile, x * TILE_SIZE, y * TILE_SIZE - draw_tile->height + TILE_SIZE, boja);
+// plocica (x, y) se menja, visoke plocice (drvece) zalaze u red iznad
+void invalidate_tile(int x, int y)
+{
+    rafgl_compositor_invalidate(&compositor, layer_tiles, x * TILE_SIZE - camera_x, y * TILE_SIZE - tilemap.overhang - camera_y, TILE_SIZE, TILE_SIZE + tilemap.overhang);
+}
+
+// tackasto uzorkovana pozadina za SPACE, ne menja se pa se puni samo jednom
+void draw_point_sampled_rows(rafgl_raster_t *target, int y_begin, int y_end, void *ctx)
+{
+    int x, y;
+
+    float xn, yn;
+
+    for(y = y_begin; y < y_end; y++) {
+        yn = 1.0f * y / raster_height;
+        for(x = 0; x < raster_width; x++) {
+            xn = 1.0f * x / raster_width;
+            pixel_at_pm(target, x, y) = rafgl_point_sample(&doge, xn, yn);
         }
     }
 }
 
 
-void main_state_init(GLFWwindow *window, void *args)
+// res/assets.txt je jedini spisak slika: make pack ga predaje alatu za pack, a odavde se iz njega proverava pack i ucitavaju
+// PNG-ovi kad pack-a nema. slike se traze po imenu, region i atlasa je i-ta slika atlasa u spisku
+#define ASSET_LIST "res/assets.txt"
+#define MAX_ASSETS 8
+#define MAX_ATLAS_IMAGES 64
+
+typedef struct
 {
-    rafgl_raster_load_from_image(&doge, "res/images/doge.png");
-    rafgl_raster_load_from_image(&checker, "res/images/checker32.png");
-    rafgl_raster_load_from_image(&mushroom, "res/images/80x60_mushriim_final.png");
+    char name[256], path[256];
+    int columns, rows;
+} asset_t;
 
-    rafgl_raster_init(&upscaled_doge, raster_width, raster_height);
-    rafgl_raster_bilinear_upsample(&upscaled_doge, &doge);
+static asset_t assets[MAX_ASSETS];
+static int asset_count;
 
-    rafgl_raster_init(&raster, raster_width, raster_height);
-    rafgl_raster_init(&raster2, raster_width, raster_height);
+// spisak ima jedan atlas, svet sa plocicama i pecurkom
+static char atlas_name[256];
+static char atlas_paths[MAX_ATLAS_IMAGES][256];
+static int atlas_image_count, atlas_width, atlas_height, atlas_padding;
+
+// sledeca rec spiska, od # do kraja reda je komentar
+static int next_word(FILE *file, char word[256])
+{
+    while(fscanf(file, "%255s", word) == 1)
+    {
+        if(word[0] != '#') return 1;
+        if(fscanf(file, "%*[^\n]") < 0) return 0;
+    }
+    return 0;
+}
+
+static int is_asset_keyword(const char *word)
+{
+    return strcmp(word, "image") == 0 || strcmp(word, "sheet") == 0 || strcmp(word, "atlas") == 0;
+}
+
+int read_asset_list(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char word[256], name[256], asset_path[256], columns[256], rows[256];
+    int ok = 1, have_word;
+    asset_t *asset;
+
+    if(file == NULL) return -1;
+
+    have_word = next_word(file, word);
+    while(ok && have_word)
+    {
+        if(strcmp(word, "atlas") == 0 && atlas_name[0] == '\0')
+        {
+            ok = next_word(file, name) && next_word(file, word) && (atlas_width = atoi(word)) > 0 &&
+                 next_word(file, word) && (atlas_height = atoi(word)) > 0 && next_word(file, word);
+            atlas_padding = atoi(word);
+            snprintf(atlas_name, sizeof(atlas_name), "%s", name);
+
+            // slike atlasa idu do sledece stavke
+            while(ok && (have_word = next_word(file, word)) && !is_asset_keyword(word))
+            {
+                if(atlas_image_count == MAX_ATLAS_IMAGES)
+                    ok = 0;
+                else
+                    snprintf(atlas_paths[atlas_image_count++], sizeof(atlas_paths[0]), "%s", word);
+            }
+            continue;
+        }
+
+        if(strcmp(word, "image") == 0 && asset_count < MAX_ASSETS && next_word(file, name) && next_word(file, asset_path))
+        {
+            asset = &assets[asset_count++];
+            asset->columns = asset->rows = 1;
+        }
+        else if(strcmp(word, "sheet") == 0 && asset_count < MAX_ASSETS && next_word(file, name) && next_word(file, asset_path) &&
+                next_word(file, columns) && next_word(file, rows))
+        {
+            asset = &assets[asset_count++];
+            asset->columns = atoi(columns);
+            asset->rows = atoi(rows);
+        }
+        else
+        {
+            ok = 0;
+            break;
+        }
+        snprintf(asset->name, sizeof(asset->name), "%s", name);
+        snprintf(asset->path, sizeof(asset->path), "%s", asset_path);
+
+        have_word = next_word(file, word);
+    }
 
+    fclose(file);
+    return ok ? 0 : -1;
+}
+
+// slika koje nema u spisku ima praznu putanju, pa se ne ucita i dobije zamenu
+static asset_t *find_asset(const char *name)
+{
+    static asset_t missing = {"", "", 1, 1};
     int i;
 
-    char tile_path[256];
+    for(i = 0; i < asset_count; i++)
+        if(strcmp(assets[i].name, name) == 0) return &assets[i];
+    return &missing;
+}
+
+// region atlasa po imenu fajla bez putanje i ekstenzije, -1 ako slike nema u atlasu
+static int atlas_region(const char *image_name)
+{
+    const char *base;
+    size_t length = strlen(image_name);
+    int i;
+
+    for(i = 0; i < atlas_image_count; i++)
+    {
+        base = strrchr(atlas_paths[i], '/');
+        base = (base != NULL) ? base + 1 : atlas_paths[i];
+        if(strncmp(base, image_name, length) == 0 && base[length] == '.') return i;
+    }
+    return -1;
+}
+
+// tilemap trazi plocice kao uzastopne regione, pecurka moze bilo gde
+int find_world_regions(void)
+{
+    char tile_name[64];
+    int i;
+
+    first_tile_region = atlas_region("svgset0");
+    mushroom_region = atlas_region("80x60_mushriim_final");
 
     for(i = 0; i < NUMBER_OF_TILES; i++)
     {
-        sprintf(tile_path, "res/tiles/svgset%d.png", i);
-        rafgl_raster_load_from_image(&tiles[i], tile_path);
+        sprintf(tile_name, "svgset%d", i);
+        if(first_tile_region < 0 || atlas_region(tile_name) != first_tile_region + i) return -1;
     }
 
-    init_tilemap();
+    return (mushroom_region >= 0) ? 0 : -1;
+}
 
-    rafgl_spritesheet_init(&hero, "res/images/character.png", 10, 4);
-    rafgl_spritesheet_init(&explosion, "res/images/313x223_explosion_final.png", 4, 2);// ovde za eksploziju dodato
+// make pack pravi res/assets.pack, iz njega se slike samo mapiraju umesto da se dekodiraju
+static rafgl_pack_t pack;
 
-    upscaled_hero_width = 1200;
-    upscaled_hero_height = 512;
+// 1 ako je neka slika ili sam spisak menjan posle pack-a, tada se pack ne koristi dok se opet ne pokrene make pack. -1 ako pack-a nema
+int pack_is_stale(const char *pack_path)
+{
+    struct stat pack_stat, image_stat;
+    int i;
 
+    if(stat(pack_path, &pack_stat) != 0) return -1;
 
-    rafgl_raster_init(&upscaled_hero, upscaled_hero_width, upscaled_hero_height);
-    rafgl_raster_init(&upscaled_hero_flipped, upscaled_hero_width, upscaled_hero_height);
+    // pack napravljen iz starijeg spiska moze da ima regione drugim redom
+    if(stat(ASSET_LIST, &image_stat) == 0 && image_stat.st_mtime > pack_stat.st_mtime) return 1;
 
-    rafgl_raster_bilinear_upsample(&upscaled_hero, &hero.sheet);
+    for(i = 0; i < asset_count; i++)
+        if(stat(assets[i].path, &image_stat) == 0 && image_stat.st_mtime > pack_stat.st_mtime) return 1;
 
-    hero_veci.sheet_height = upscaled_hero_height;
-    hero_veci.sheet_width = upscaled_hero_width;
+    for(i = 0; i < atlas_image_count; i++)
+        if(stat(atlas_paths[i], &image_stat) == 0 && image_stat.st_mtime > pack_stat.st_mtime) return 1;
 
-    hero_veci.sheet = upscaled_hero;
+    return 0;
+}
 
-    hero_veci.frame_height = upscaled_hero_height / 4;
-    hero_veci.frame_width = upscaled_hero_width / 10;
+int load_assets_from_pack(void)
+{
+    int stale = pack_is_stale("res/assets.pack");
 
-    hero_veci_flipped.sheet_height = upscaled_hero_height;
-    hero_veci_flipped.sheet_width = upscaled_hero_width;
+    if(stale > 0)
+        fprintf(stderr, "res/assets.pack je stariji od slika, ucitavaju se PNG-ovi\n");
+    if(stale != 0) return -1;
 
-    hero_veci_flipped.sheet = upscaled_hero_flipped;
+    if(rafgl_pack_open(&pack, "res/assets.pack") != 0) return -1;
 
-    hero_veci_flipped.frame_height = upscaled_hero_height / 4;
-    hero_veci_flipped.frame_width = upscaled_hero_width / 10;
+    // pack nije stariji od spiska, pa su regioni atlasa poredjani kao slike u spisku
+    if(rafgl_pack_raster(&pack, "doge", &doge) == 0 && rafgl_pack_raster(&pack, "checker", &checker) == 0 &&
+       rafgl_pack_spritesheet(&pack, "hero", &hero) == 0 && rafgl_pack_spritesheet(&pack, "explosion", &explosion) == 0 &&
+       rafgl_pack_atlas(&pack, atlas_name, &atlas) == 0 && atlas.region_count == atlas_image_count)
+    {
+        return 0;
+    }
+
+    // zastareo pack, vraca se na PNG-ove
+    rafgl_raster_cleanup(&doge);
+    rafgl_raster_cleanup(&checker);
+    rafgl_raster_cleanup(&hero.sheet);
+    rafgl_raster_cleanup(&explosion.sheet);
+    rafgl_atlas_cleanup(&atlas);
+    rafgl_pack_close(&pack);
+    return -1;
+}
+
+// bez pack-a se slike dekodiraju paralelno: bez plocica i sprajtova se ne moze poceti, doge stize kad stigne
+static rafgl_loader_t doge_loader;
+static int doge_handle = -1, doge_ready = 0;
+
+// zamena za sliku koja nije ucitana: ljubicasto-crna sahovnica, vidi se sta fali a ostatak koda radi kao da je slika tu
+static void missing_image(rafgl_raster_t *image, int width, int height)
+{
+    int x, y;
+
+    rafgl_raster_init(image, width, height);
+    for(y = 0; y < height; y++)
+        for(x = 0; x < width; x++)
+            pixel_at_pm(image, x, y).rgba = ((x / 8 + y / 8) % 2) ? rafgl_RGB(255, 0, 255) : rafgl_RGB(0, 0, 0);
+}
+
+static void missing_spritesheet(rafgl_spritesheet_t *spritesheet, int sheet_width, int sheet_height, int frame_width, int frame_height)
+{
+    missing_image(&spritesheet->sheet, sheet_width * frame_width, sheet_height * frame_height);
+    spritesheet->sheet_width = sheet_width;
+    spritesheet->sheet_height = sheet_height;
+    spritesheet->frame_width = frame_width;
+    spritesheet->frame_height = frame_height;
+}
+
+void load_assets(void)
+{
+    int i, checker_handle, hero_handle, explosion_handle;
+    int atlas_handles[MAX_ATLAS_IMAGES];
+    rafgl_raster_t atlas_images[MAX_ATLAS_IMAGES];
+    asset_t *hero_asset, *explosion_asset;
+    rafgl_loader_t loader;
+
+    // bez spiska se ne zna ni sta da se ucita ni gde su plocice u atlasu
+    if(read_asset_list(ASSET_LIST) != 0 || find_world_regions() != 0)
+    {
+        fprintf(stderr, "%s nije ispravan ili u atlasu nema svih plocica i pecurke\n", ASSET_LIST);
+        exit(1);
+    }
+
+    if(load_assets_from_pack() == 0)
+    {
+        doge_ready = 1;
+        return;
+    }
+
+    rafgl_loader_init(&doge_loader, 1);
+    doge_handle = rafgl_loader_add_image(&doge_loader, find_asset("doge")->path, &doge);
+    rafgl_loader_start(&doge_loader);
+
+    hero_asset = find_asset("hero");
+    explosion_asset = find_asset("explosion");
+
+    rafgl_loader_init(&loader, atlas_image_count + 3);
+    checker_handle = rafgl_loader_add_image(&loader, find_asset("checker")->path, &checker);
+    for(i = 0; i < atlas_image_count; i++)
+        atlas_handles[i] = rafgl_loader_add_image(&loader, atlas_paths[i], &atlas_images[i]);
+    hero_handle = rafgl_loader_add_spritesheet(&loader, hero_asset->path, &hero, hero_asset->columns, hero_asset->rows);
+    explosion_handle = rafgl_loader_add_spritesheet(&loader, explosion_asset->path, &explosion, explosion_asset->columns, explosion_asset->rows);// ovde za eksploziju dodato
+
+    // sta nije ucitano dobija zamenu velicine prave slike, atlas i crtanje ne moraju nista da preskacu
+    if(rafgl_loader_wait(&loader) != 0)
+    {
+        fprintf(stderr, "neke slike nisu ucitane, umesto njih se crta sahovnica\n");
+
+        if(rafgl_loader_state(&loader, checker_handle) == RAFGL_LOAD_FAILED)
+            missing_image(&checker, 32, 32);
+        for(i = 0; i < atlas_image_count; i++)
+            if(rafgl_loader_state(&loader, atlas_handles[i]) == RAFGL_LOAD_FAILED)
+            {
+                if(i == mushroom_region)
+                    missing_image(&atlas_images[i], 80, 60);
+                else
+                    missing_image(&atlas_images[i], TILE_SIZE, TILE_SIZE);
+            }
+        if(rafgl_loader_state(&loader, hero_handle) == RAFGL_LOAD_FAILED)
+            missing_spritesheet(&hero, hero_asset->columns, hero_asset->rows, 60, 64);
+        if(rafgl_loader_state(&loader, explosion_handle) == RAFGL_LOAD_FAILED)
+            missing_spritesheet(&explosion, explosion_asset->columns, explosion_asset->rows, 78, 111);
+    }
+    rafgl_loader_cleanup(&loader);
+
+    // region i je i-ta slika, kao u pack-u
+    rafgl_atlas_init(&atlas, atlas_width, atlas_height, atlas_padding);
+    for(i = 0; i < atlas_image_count; i++)
+    {
+        if(rafgl_atlas_add(&atlas, &atlas_images[i]) != i)
+            fprintf(stderr, "%s ne staje u atlas %s\n", atlas_paths[i], atlas_name);
+        rafgl_raster_cleanup(&atlas_images[i]);
+    }
+}
+
+// dok doge ne stigne pozadina je sahovnica
+void fill_placeholder_background(void)
+{
+    int x, y;
+
+    if(checker.data == NULL) return;
+
+    for(y = 0; y < raster_height; y++)
+        for(x = 0; x < raster_width; x++)
+            pixel_at_m(upscaled_doge, x, y) = pixel_at_m(checker, x % checker.width, y % checker.height);
+}
+
+void doge_loaded(void)
+{
+    rafgl_raster_bilinear_upsample(&upscaled_doge, &doge);
+    rafgl_parallel_for_rows(&raster2, draw_point_sampled_rows, NULL);
+    rafgl_raster_mark_dirty(&raster2, 0, 0, raster_width, raster_height);
+}
+
+void main_state_init(GLFWwindow *window, void *args)
+{
+    load_assets();
+
+    rafgl_raster_init(&upscaled_doge, raster_width, raster_height);
+    rafgl_raster_init(&raster, raster_width, raster_height);
+    rafgl_raster_init(&raster2, raster_width, raster_height);
+    rafgl_raster_track_dirty(&raster);
+    rafgl_raster_track_dirty(&raster2);
+
+    if(doge_ready)
+        doge_loaded();
+    else
+        fill_placeholder_background();
+
+    int i;
+
+    rafgl_atlas_finish(&atlas);
+
+    init_tilemap();
+
+    rafgl_compositor_init(&compositor, raster_width, raster_height);
+    layer_background = rafgl_compositor_add_layer(&compositor, RAFGL_LAYER_OPAQUE, render_background, NULL);
+    layer_tiles = rafgl_compositor_add_layer(&compositor, 0, render_tilemap, NULL);
+    layer_sprites = rafgl_compositor_add_layer(&compositor, RAFGL_LAYER_VOLATILE, NULL, NULL);
+
+    rafgl_spritesheet_build_spans(&hero);
+    rafgl_spritesheet_build_spans(&explosion);
+
+    rafgl_anim_clip_init_row(&hero_clip, &hero, 0, 0, hero.sheet_width, ANIMATION_FRAME_TIME, 1);
+    rafgl_animator_play(&hero_anim, &hero_clip);
+
+    rafgl_anim_clip_init(&explosion_clip, &explosion, explosion.sheet_width * explosion.sheet_height, 0);
+    for(i = 0; i < explosion_clip.frame_count; i++)
+        rafgl_anim_clip_set_frame(&explosion_clip, i, i % explosion.sheet_width, i / explosion.sheet_width, ANIMATION_FRAME_TIME);
+
+    // veci heroj se skalira pri crtanju iz istog lista
+    hero_veci_width = hero.frame_width * 2;
+    hero_veci_height = hero.frame_height * 2;
+
+    rafgl_spatial_init(&colliders, TILE_SIZE, 16);
+    hero_body = rafgl_spatial_insert(&colliders, 0, 0, 1, 1);
+    mushroom_body = rafgl_spatial_insert(&colliders, 0, 0, 1, 1);
 
     rafgl_texture_init(&texture);
+    rafgl_texture_set_upload_mode(&texture, RAFGL_UPLOAD_PBO | RAFGL_UPLOAD_DIRTY);
 }
 
 
@@ -144,21 +470,17 @@ float location = 0;
 float selector = 0;
 
 int animation_running = 0;
-int animation_frame = 0;
 int direction = 0;
 
 int animation_exposion = 0;
 
-int hero_pos_x = RASTER_WIDTH / 2;
-int hero_pos_y = RASTER_HEIGHT / 2;
+int hero_pos_x = WORLD_SIZE * TILE_SIZE / 2;
+int hero_pos_y = WORLD_SIZE * TILE_SIZE / 2;
 
 int hero_speed = 300;
 
-int hover_frames = 0;
-int hover_frames_explosion = 0;
-
-int poz_x = 600;
-int poz_y = 600;
+int poz_x = WORLD_SIZE * TILE_SIZE / 2 + 88;
+int poz_y = WORLD_SIZE * TILE_SIZE / 2 + 216;
 
 static int pom_poz_x = 0;
 static int pom_poz_y = 0;
@@ -168,91 +490,96 @@ int gore_dole = 0;
 int veci = 0;
 
 int udario = 0;
-int animation_frame_exposion = 0;
-int row = 0;
 
 
 
-void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args)
+void update_camera(void)
 {
-    int x, y;
-
-    float xn, yn;
+    int x = rafgl_clampi(hero_pos_x + hero.frame_width / 2 - raster_width / 2, 0, WORLD_SIZE * TILE_SIZE - raster_width);
+    int y = rafgl_clampi(hero_pos_y + hero.frame_height / 2 - raster_height / 2, 0, WORLD_SIZE * TILE_SIZE - raster_height);
 
-    rafgl_pixel_rgb_t sampled1, sampled2, resulting1, resulting2;
-
-
-    for(y = 0; y < raster_height; y++) {
-        yn = 1.0f * y / raster_height;
-        for(x = 0; x < raster_width; x++) {
-            xn = 1.0f * x / raster_width;
+    if(x != camera_x || y != camera_y)
+    {
+        camera_x = x;
+        camera_y = y;
+        rafgl_compositor_invalidate(&compositor, layer_tiles, 0, 0, raster_width, raster_height);
+    }
+}
 
-            sampled1 = pixel_at_m(upscaled_doge, x, y);
-            sampled2 = rafgl_point_sample(&doge, xn, yn);
+// da li se telo preklapa sa herojem
+int hero_touches(int body)
+{
+    int hits[8], count, i;
+    rafgl_spatial_item_t *h = &colliders.items[hero_body];
 
-            resulting1 = sampled1;
-            resulting2 = sampled2;
+    count = rafgl_spatial_query(&colliders, h->x, h->y, h->width, h->height, hits, 8);
+    for(i = 0; i < count && i < 8; i++)
+        if(hits[i] == body) return 1;
+    return 0;
+}
 
-            resulting1.rgba = rafgl_RGB(0, 0, 0);
-            resulting1 = sampled1;
+void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *game_data, void *args)
+{
+    rafgl_raster_t *sprites = rafgl_compositor_layer(&compositor, layer_sprites);
 
-            pixel_at_m(raster, x, y) = resulting1;
-            pixel_at_m(raster2, x, y) = resulting2;
+    if(!doge_ready && rafgl_loader_state(&doge_loader, doge_handle) != RAFGL_LOAD_PENDING)
+    {
+        doge_ready = 1;
+        if(rafgl_loader_state(&doge_loader, doge_handle) == RAFGL_LOAD_DONE)
+        {
+            doge_loaded();
+            rafgl_compositor_invalidate(&compositor, layer_background, 0, 0, raster_width, raster_height);
         }
     }
 
-    poz_x = poz_x % raster.width;
-    poz_y = poz_y % raster.height;
-
-    render_tilemap(&raster);
+    rafgl_compositor_begin_frame(&compositor);
+    update_camera();
 
     // CRTANJE PEURKE
     if(!udario){
 
-        rafgl_raster_draw_raster(&raster, &mushroom, poz_x - 30, poz_y - 40, boja);
+        rafgl_raster_draw_region(sprites, &atlas, mushroom_region, poz_x - 30 - camera_x, poz_y - 40 - camera_y, boja, 0);
     }
     else {
         boja.rgba = rafgl_RGB(rand() % 256, rand() % 256, rand() % 256);
+        // boja boji i plocice
+        rafgl_tilemap_set_tint(&tilemap, boja);
+        rafgl_compositor_invalidate(&compositor, layer_tiles, 0, 0, raster_width, raster_height);
     }
 
 
     // HIT BOKS ZA HEROJA I PEURKU
-    if(!veci){
-        if(hero_pos_x + 60 >= poz_x - 30 && hero_pos_y <= poz_y + 40 &&
-            hero_pos_x <= poz_x + 30 && hero_pos_y  + 64 >= poz_y - 40){
-            udario = 1;
-            if(udario) {
-                pom_poz_x = poz_x;
-                pom_poz_y = poz_y;
-            }
-            poz_x = rand() % raster.width;
-            poz_y = rand() % raster.height;
-            gore_dole = 0;
-        }
-    }
-    else {
-        if(hero_pos_x + 120 >= poz_x - 30 && hero_pos_y <= poz_y + 40 &&
-            hero_pos_x <= poz_x + 30 && hero_pos_y  + 128 >= poz_y - 40){
-            udario = 1;
-            if(udario) {
-                pom_poz_x = poz_x;
-                pom_poz_y = poz_y;
-            }
-            poz_x = rand() % raster.width;
-            poz_y = rand() % raster.height;
+    rafgl_spatial_move(&colliders, mushroom_body, poz_x - 30, poz_y - 40, MUSHROOM_WIDTH + 1, MUSHROOM_HEIGHT + 1);
+    if(!veci)
+        rafgl_spatial_move(&colliders, hero_body, hero_pos_x, hero_pos_y, hero.frame_width + 1, hero.frame_height + 1);
+    else
+        rafgl_spatial_move(&colliders, hero_body, hero_pos_x, hero_pos_y, hero_veci_width + 1, hero_veci_height + 1);
+
+    if(hero_touches(mushroom_body)){
+        udario = 1;
+        rafgl_animator_play(&explosion_anim, &explosion_clip);
+        if(udario) {
+            pom_poz_x = poz_x;
+            pom_poz_y = poz_y;
         }
+        poz_x = camera_x + rand() % raster.width;
+        poz_y = camera_y + rand() % raster.height;
+        if(!veci)
+            gore_dole = 0;
     }
 
     // RUENJE DRVEA KDA VELIKI HEROJ IM PRIDJE
     if(veci) {
         if(gore_dole == 0){
-            if(tile_world[(hero_pos_y + 128) / TILE_SIZE][(hero_pos_x + 60) / TILE_SIZE] >= 3 ){
-                tile_world[(hero_pos_y + 128) / TILE_SIZE][(hero_pos_x + 60) / TILE_SIZE] = rand() % 3;
+            if(rafgl_tilemap_get_tile(&tilemap, (hero_pos_x + 60) / TILE_SIZE, (hero_pos_y + 128) / TILE_SIZE) >= 3 ){
+                rafgl_tilemap_set_tile(&tilemap, (hero_pos_x + 60) / TILE_SIZE, (hero_pos_y + 128) / TILE_SIZE, rand() % 3);
+                invalidate_tile((hero_pos_x + 60) / TILE_SIZE, (hero_pos_y + 128) / TILE_SIZE);
             }
         }
         else {
-            if(tile_world[(hero_pos_y) / TILE_SIZE][(hero_pos_x + 60) / TILE_SIZE] >= 3 ){
-                tile_world[(hero_pos_y) / TILE_SIZE][(hero_pos_x + 60) / TILE_SIZE] = rand() % 3;
+            if(rafgl_tilemap_get_tile(&tilemap, (hero_pos_x + 60) / TILE_SIZE, (hero_pos_y) / TILE_SIZE) >= 3 ){
+                rafgl_tilemap_set_tile(&tilemap, (hero_pos_x + 60) / TILE_SIZE, (hero_pos_y) / TILE_SIZE, rand() % 3);
+                invalidate_tile((hero_pos_x + 60) / TILE_SIZE, (hero_pos_y) / TILE_SIZE);
             }
         }
     }
@@ -276,7 +603,7 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
                 direction = 2;
             }
             else {
-                if(tile_world[(hero_pos_y + 64) / TILE_SIZE - 1][(hero_pos_x + 30) / TILE_SIZE] < 3){
+                if(rafgl_tilemap_get_tile(&tilemap, (hero_pos_x + 30) / TILE_SIZE, (hero_pos_y + 64) / TILE_SIZE - 1) < 3){
                     hero_pos_y = hero_pos_y - hero_speed * delta_time;
                     direction = 2;
                 }
@@ -289,7 +616,7 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
                 direction = 0;
             }
             else {
-                if(tile_world[(hero_pos_y ) / TILE_SIZE + 1][(hero_pos_x + 30) / TILE_SIZE] < 3){
+                if(rafgl_tilemap_get_tile(&tilemap, (hero_pos_x + 30) / TILE_SIZE, (hero_pos_y ) / TILE_SIZE + 1) < 3){
                     hero_pos_y = hero_pos_y + hero_speed * delta_time;
                     direction = 0;
                 }
@@ -302,7 +629,7 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
                 direction = 1;
             }
             else {
-                if(tile_world[(hero_pos_y + 32) / TILE_SIZE][(hero_pos_x + 60) / TILE_SIZE - 1] < 3){
+                if(rafgl_tilemap_get_tile(&tilemap, (hero_pos_x + 60) / TILE_SIZE - 1, (hero_pos_y + 32) / TILE_SIZE) < 3){
                     hero_pos_x = hero_pos_x - hero_speed * delta_time;
                     direction = 1;
                 }
@@ -315,7 +642,7 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
                 direction = 3;
             }
             else {
-                if(tile_world[(hero_pos_y + 32) / TILE_SIZE][(hero_pos_x ) / TILE_SIZE + 1] < 3){
+                if(rafgl_tilemap_get_tile(&tilemap, (hero_pos_x ) / TILE_SIZE + 1, (hero_pos_y + 32) / TILE_SIZE) < 3){
                     hero_pos_x = hero_pos_x + hero_speed * delta_time;
                     direction = 3;
                 }
@@ -327,18 +654,7 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
         }
 
         if(animation_running)
-        {
-            if(hover_frames == 0)
-            {
-                animation_frame = (animation_frame + 1) % 10;
-                hover_frames = 5;
-            }
-            else
-            {
-                hover_frames--;
-            }
-
-        }
+            rafgl_animator_update(&hero_anim, 1, delta_time);
     }
     else {
         if(game_data->keys_down[RAFGL_KEY_W])
@@ -367,48 +683,12 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
         }
 
         if(animation_running)
-        {
-            if(hover_frames == 0)
-            {
-                animation_frame = (animation_frame + 1) % 10;
-                hover_frames = 5;
-            }
-            else
-            {
-                hover_frames--;
-            }
-
-        }
+            rafgl_animator_update(&hero_anim, 1, delta_time);
     }
 
     // SMENJIVANJE SLIKA ZA ANIMACIJU EKSPLOZIJE
-    if(udario){
-        if(hover_frames_explosion == 0)
-        {
-            animation_frame_exposion++;
-            if(animation_frame_exposion == 4){
-                animation_frame_exposion = 0;
-                row = 1;
-            }
-            hover_frames_explosion = 5;
-        }
-        else
-        {
-            hover_frames_explosion--;
-        }
-    }
-
-    rafgl_pixel_rgb_t sampled, resulting3;
-
-    // PRAVLJENJE FLIPOVANOG HEROJA
-    for(y = 0; y < upscaled_hero_height; y++) {
-        for(x = 0; x < upscaled_hero_width; x++) {
-            sampled = pixel_at_m(upscaled_hero, x, upscaled_hero_height - y - 1);
-            resulting3 = sampled;
-            pixel_at_m(upscaled_hero_flipped, x,y) = resulting3;
-
-        }
-    }
+    if(udario)
+        rafgl_animator_update(&explosion_anim, 1, delta_time);
 
     // BIRANJE IZMEDJU MALOG I VELIKOG HEROJA
     if(game_data->keys_down[RAFGL_KEY_B]){
@@ -419,36 +699,67 @@ void main_state_update(GLFWwindow *window, float delta_time, rafgl_game_data_t *
     }
 
 
+    // heroj ne izlazi van sveta
+    hero_pos_x = rafgl_clampi(hero_pos_x, 0, WORLD_SIZE * TILE_SIZE - (veci ? hero_veci_width : hero.frame_width));
+    hero_pos_y = rafgl_clampi(hero_pos_y, 0, WORLD_SIZE * TILE_SIZE - (veci ? hero_veci_height : hero.frame_height));
+
     // ISCRTAVALJE MALOG VELIKOG I OKRENUTOG HEROJA
     if(!veci) {
         hero_speed = 450;
-        rafgl_raster_draw_spritesheet(&raster, &hero, animation_frame, direction, hero_pos_x, hero_pos_y);// ovo sve crta
+        rafgl_raster_draw_spritesheet(sprites, &hero, rafgl_animator_sheet_x(&hero_anim), direction, hero_pos_x - camera_x, hero_pos_y - camera_y);// ovo sve crta
     }
     else {
         hero_speed = 150;
         if(gore_dole == 0){
-            rafgl_raster_draw_spritesheet(&raster, &hero_veci, animation_frame, direction, hero_pos_x, hero_pos_y);
+            rafgl_raster_draw_spritesheet_scaled(sprites, &hero, rafgl_animator_sheet_x(&hero_anim), direction, hero_pos_x - camera_x, hero_pos_y - camera_y, hero_veci_width, hero_veci_height, RAFGL_SAMPLE_BILINEAR, 0);
         }
         else {
-            rafgl_raster_draw_spritesheet(&raster, &hero_veci_flipped, animation_frame, direction, hero_pos_x, hero_pos_y);
+            // okrenut heroj: red iz obrnutog lista, crtan naopako
+            rafgl_raster_draw_spritesheet_scaled(sprites, &hero, rafgl_animator_sheet_x(&hero_anim), 3 - direction, hero_pos_x - camera_x, hero_pos_y - camera_y, hero_veci_width, hero_veci_height, RAFGL_SAMPLE_BILINEAR, RAFGL_FLIP_VERTICAL);
         }
     }
 
 
     // ICRTAVANJE ANIMACIJE EKSPLOZIJE
     if(udario){
-        rafgl_raster_draw_spritesheet(&raster, &explosion, animation_frame_exposion, row, pom_poz_x - 39, pom_poz_y - 55);
-        if(row == 1 && animation_frame_exposion == 3){
+        rafgl_animator_draw(&explosion_anim, sprites, pom_poz_x - 39 - camera_x, pom_poz_y - 55 - camera_y, 0);
+        if(!explosion_anim.playing)
             udario = 0;
-            row = 0;
-            animation_frame_exposion = 0;
-        }
     }
 
+    rafgl_compositor_compose(&compositor, &raster);
+
     if(!game_data->keys_down[RAFGL_KEY_SPACE])
         rafgl_texture_load_from_raster(&texture, &raster);
     else
         rafgl_texture_load_from_raster(&texture, &raster2);
+
+    // U ispisuje koliko traje slanje rastera na GPU i koliko je privremene memorije trebalo
+    if(game_data->keys_pressed[RAFGL_KEY_U] && texture.stats.uploads > 0)
+    {
+        printf("upload: %.3f ms (avg %.3f ms), fence wait: %.3f ms (avg %.3f ms)\n",
+               texture.stats.upload_time * 1000.0, texture.stats.upload_time_total * 1000.0 / texture.stats.uploads,
+               texture.stats.fence_wait_time * 1000.0, texture.stats.fence_wait_time_total * 1000.0 / texture.stats.uploads);
+        printf("frame arena peak: %.1f KB\n", rafgl_frame_arena_high_water() / 1024.0);
+    }
+
+    // T ispisuje koliko providnih ivica je odseceno sa sprajtova
+    if(game_data->keys_pressed[RAFGL_KEY_T])
+    {
+        int i, kept = 0, total = 0;
+        rafgl_atlas_region_t *r;
+
+        for(i = 0; i < NUMBER_OF_TILES; i++)
+        {
+            r = &atlas.regions[first_tile_region + i];
+            kept += r->width * r->height;
+            total += r->source_width * r->source_height;
+        }
+
+        printf("trimmed: hero %.1f%%, explosion %.1f%%, tiles %.1f%%\n",
+               rafgl_raster_trimmed_fraction(&hero.sheet, -1) * 100.0f, rafgl_raster_trimmed_fraction(&explosion.sheet, -1) * 100.0f,
+               100.0f - kept * 100.0f / total);
+    }
 }
 
 
@@ -462,6 +773,20 @@ void main_state_cleanup(GLFWwindow *window, void *args)
 {
     rafgl_raster_cleanup(&raster);
     rafgl_raster_cleanup(&raster2);
+    rafgl_compositor_cleanup(&compositor);
+    rafgl_tilemap_cleanup(&tilemap);
+    rafgl_atlas_cleanup(&atlas);
+    rafgl_spatial_cleanup(&colliders);
+    rafgl_anim_clip_cleanup(&hero_clip);
+    rafgl_anim_clip_cleanup(&explosion_clip);
     rafgl_texture_cleanup(&texture);
 
+    if(doge_handle >= 0)
+        rafgl_loader_cleanup(&doge_loader);
+    rafgl_raster_cleanup(&doge);
+    rafgl_raster_cleanup(&upscaled_doge);
+    rafgl_raster_cleanup(&checker);
+    rafgl_raster_cleanup(&hero.sheet);
+    rafgl_raster_cleanup(&explosion.sheet);
+    rafgl_pack_close(&pack);
 }
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+
+#define RAFGL_IMPLEMENTATION
+#include <rafgl.h>
+
+/*
+    decodes images once and writes them into a pack rafgl_pack_open can map
+
+    rafgl_pack.out <pack> <asset>...
+        image <name> <path>
+        sheet <name> <path> <columns> <rows>
+        atlas <name> <width> <height> <padding> <path>...    (paths up to the next asset, region i is the i-th path)
+*/
+
+static int is_keyword(const char *arg)
+{
+    return strcmp(arg, "image") == 0 || strcmp(arg, "sheet") == 0 || strcmp(arg, "atlas") == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    rafgl_game_t game;
+    rafgl_pack_writer_t writer;
+    rafgl_raster_t image;
+    rafgl_spritesheet_t sheet;
+    rafgl_atlas_t atlas;
+    int i = 2;
+
+    if(argc < 3)
+    {
+        fprintf(stderr, "usage: %s <pack> [image <name> <path>] [sheet <name> <path> <columns> <rows>] [atlas <name> <width> <height> <padding> <path>...]\n", argv[0]);
+        return 1;
+    }
+
+    /* only for the colour keys the trims are computed against */
+    rafgl_game_init_headless(&game, 1, 1);
+
+    if(rafgl_pack_writer_open(&writer, argv[1]) != 0)
+    {
+        fprintf(stderr, "cannot write %s\n", argv[1]);
+        return 1;
+    }
+
+    while(i < argc)
+    {
+        if(strcmp(argv[i], "image") == 0 && i + 2 < argc)
+        {
+            rafgl_raster_load_from_image(&image, argv[i + 2]);
+            if(image.data == NULL)
+            {
+                fprintf(stderr, "cannot load %s\n", argv[i + 2]);
+                return 1;
+            }
+            rafgl_pack_writer_add_raster(&writer, argv[i + 1], &image);
+            rafgl_raster_cleanup(&image);
+            i += 3;
+        }
+        else if(strcmp(argv[i], "sheet") == 0 && i + 4 < argc)
+        {
+            rafgl_spritesheet_init(&sheet, argv[i + 2], atoi(argv[i + 3]), atoi(argv[i + 4]));
+            if(sheet.sheet.data == NULL)
+            {
+                fprintf(stderr, "cannot load %s\n", argv[i + 2]);
+                return 1;
+            }
+            rafgl_pack_writer_add_spritesheet(&writer, argv[i + 1], &sheet);
+            rafgl_raster_cleanup(&sheet.sheet);
+            i += 5;
+        }
+        else if(strcmp(argv[i], "atlas") == 0 && i + 4 < argc)
+        {
+            const char *name = argv[i + 1];
+
+            rafgl_atlas_init(&atlas, atoi(argv[i + 2]), atoi(argv[i + 3]), atoi(argv[i + 4]));
+            for(i += 5; i < argc && !is_keyword(argv[i]); i++)
+            {
+                rafgl_raster_load_from_image(&image, argv[i]);
+                if(image.data == NULL || rafgl_atlas_add(&atlas, &image) < 0)
+                {
+                    fprintf(stderr, "cannot load %s into atlas %s\n", argv[i], name);
+                    return 1;
+                }
+                rafgl_raster_cleanup(&image);
+            }
+            rafgl_pack_writer_add_atlas(&writer, name, &atlas);
+            rafgl_atlas_cleanup(&atlas);
+        }
+        else
+        {
+            fprintf(stderr, "bad asset at '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if(rafgl_pack_writer_close(&writer) != 0)
+    {
+        fprintf(stderr, "writing %s failed\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}